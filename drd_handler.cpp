@@ -2,377 +2,2869 @@
  * @file drd_handler.cpp
  * @brief Double-reset detection backend implementation.
  *
- * This module provides the implementation of the DoubleResetDetector class.
- * It supports RTC slow-memory and NVS persistence backends.
+ * This module provides the implementation of the BasicDetector class
+ * template and its RTC slow-memory, NVS, Hybrid and flash ring storage
+ * policies. Only the policy selected in Kconfig is compiled and
+ * instantiated.
  *
- * The NVS backend reduces false double-reset detection during firmware
+ * The NVS-style backends reduce false double-reset detection during firmware
  * flashing by tracking the application image using the embedded ELF SHA-256
- * and treating tooling-style reset reasons as non-user resets.
+ * and applying the per-reset-reason policy from Kconfig.
  */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cinttypes>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 
+#include "sdkconfig.h"
+
 extern "C"
 {
 #include <esp_app_desc.h>
+#include <esp_attr.h>
 #include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_rtc_time.h>
 #include <esp_system.h>
 #include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#if defined(CONFIG_DRD_BACKEND_NVS) || defined(CONFIG_DRD_BACKEND_HYBRID)
 #include <nvs.h>
 #include <nvs_flash.h>
+#endif
+#if defined(CONFIG_DRD_BACKEND_FLASH)
+#include <esp_partition.h>
+#endif
+
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+#include <esp_private/startup_internal.h>
+#endif
+
+#if defined(CONFIG_DRD_TRACE)
+#include <SEGGER_SYSVIEW.h>
+#endif
 }
 
 #include "drd_handler.hpp"
 
-#include "sdkconfig.h"
-
 /// @brief Log tag for this module.
 static const char *TAG = "drd_handler";
 
+#if defined(CONFIG_DRD_POST_EVENTS)
+ESP_EVENT_DEFINE_BASE(DRD_EVENT);
+#endif
+
 namespace
 {
-    // "DOBI ESEE" → "DOUBLEST", an arbitrary magic value.
-    constexpr uint32_t kDrdMagic = 0xD0B1E5E5u;
+    // RTC_NOINIT_ATTR is not reloaded by the bootloader, so these records
+    // survive every reset that keeps RTC memory powered (RTC_DATA_ATTR is
+    // reloaded on every reset except deep-sleep wakeup). After power loss
+    // they hold garbage and fail the CRC check.
+
+    // Each RTC record is kept twice. A store fills the slot that does not
+    // hold the newest valid copy and only then advances that slot's
+    // sequence number, one aligned word, so a reset in the middle of a
+    // store leaves the previous copy to load instead of no record at all.
+    template <typename Record>
+    struct RtcSlots
+    {
+        Record slot[2];
+        uint32_t sequence[2];
+    };
+
+    // RtcStorage record, also used as the fallback when NVS is unavailable.
+    RTC_NOINIT_ATTR RtcSlots<drd_handler::StateRecord> s_rtc_record;
+
+#if defined(CONFIG_DRD_BACKEND_HYBRID)
+    // Hybrid backend copy of the state record, together with the last
+    // record known to be in NVS, so RTC-sourced boots can decide whether
+    // NVS needs an update without reading it. Both change in one store.
+    struct HybridRtcState
+    {
+        drd_handler::StateRecord state;
+        drd_handler::StateRecord nvs; // Invalid when NVS is unknown.
+    };
+
+    RTC_NOINIT_ATTR RtcSlots<HybridRtcState> s_rtc_state;
+#endif
+
+#if defined(CONFIG_DRD_NVS_RTC_CACHE)
+    // NVS backend mirror of the record last read from or written to NVS,
+    // so boots that kept RTC memory skip the NVS read.
+    RTC_NOINIT_ATTR RtcSlots<drd_handler::StateRecord> s_nvs_mirror;
+#endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    // Reset history ring. The NVS copy is refreshed by flush() and by
+    // detections only, so recording a boot never writes flash.
+    struct HistoryRing
+    {
+        uint32_t magic;
+        uint8_t head;         // Slot the next entry goes into.
+        uint8_t count;        // Valid entries, up to kHistoryLength.
+        uint8_t unsaved;      // Entries added since the NVS copy.
+        uint8_t reserved;     // Padding, always zero.
+        uint32_t last_rtc_ms; // RTC clock at the newest entry, or unknown.
+        uint32_t entries[drd_handler::kHistoryLength];
+        uint32_t crc;
+    };
+
+    RTC_NOINIT_ATTR HistoryRing s_history;
+#endif
+
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+    constexpr uint8_t kToolingGaps = 4;
+
+    // Recent gaps between a boot that delayed arming and the tooling reset
+    // that followed it. Tooling resets keep RTC memory, so the arm delay
+    // adapts without a flash write; power loss starts over.
+    struct ToolingTiming
+    {
+        uint32_t magic;
+        uint8_t pending;        // The last evaluated boot delayed arming.
+        uint8_t next;           // Slot the next gap goes into.
+        uint8_t count;          // Valid gaps, up to kToolingGaps.
+        uint8_t reserved;       // Padding, always zero.
+        uint32_t delayed_at_ms; // RTC clock when that boot was evaluated.
+        uint32_t gaps_ms[kToolingGaps];
+        uint32_t crc;
+    };
+
+    RTC_NOINIT_ATTR ToolingTiming s_tooling;
+#endif
+
+    constexpr size_t kSha256Len = 32;
 
-    // RTC slow memory survives soft resets and normal resets, but not power loss.
-    RTC_DATA_ATTR uint32_t s_rtc_magic = 0;
+    // "DRDS" in little-endian byte order.
+    constexpr uint32_t kStateMagic = 0x53445244u;
+    // A truncated identity changes the layout, so it has its own version.
+    constexpr uint8_t kStateVersion =
+        (drd_handler::kIdentityLen == kSha256Len) ? 3 : 4;
+
+    // State record flag bits.
+    constexpr uint8_t kFlagArmed = 1u << 0;
+    constexpr uint8_t kFlagDirty = 1u << 1;
+    constexpr uint8_t kFlagFirstBoot = 1u << 2;
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    constexpr const char *kNvsPartition = CONFIG_DRD_NVS_PARTITION;
+
+    // "DOBI ESEE" → "DOUBLEST", the arm marker used by the legacy keys.
+    constexpr uint32_t kDrdMagic = 0xD0B1E5E5u;
 
     // NVS backend keys.
 
+    // Packed state record, see drd_handler::StateRecord.
+    constexpr const char *kKeyState = "state";
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    // Reset history ring, see HistoryRing.
+    constexpr const char *kKeyHistory = "history";
+#endif
+
+    // Per-key state used before the packed record. Migrated once, then erased.
     constexpr const char *kKeyMagic = "magic";
     // Kept for compatibility with earlier versions.
     constexpr const char *kKeyBoot = "last_boot_us";
     // Legacy 32-bit identity, kept for migration only.
     constexpr const char *kKeyAppHash = "app_hash";
-    // Preferred firmware identity.
     constexpr const char *kKeyAppSha256 = "app_sha256";
     constexpr const char *kKeyDirty = "fw_dirty";
     constexpr const char *kKeyFirstBoot = "first_boot";
+#endif
 
-    constexpr size_t kSha256Len = 32;
+#if defined(CONFIG_DRD_MAX_WRITES_PER_BOOT)
+    constexpr uint32_t kMaxWritesPerBoot = CONFIG_DRD_MAX_WRITES_PER_BOOT;
+#else
+    constexpr uint32_t kMaxWritesPerBoot = 0;
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_FLASH)
+    constexpr const char *kRingPartition = CONFIG_DRD_FLASH_PARTITION;
+
+    // Flash ring layout. Every sector holds a header and a run of record
+    // slots. A slot is claimed by clearing its bit in the header bitmap
+    // before the record is written, so bits only go from 1 to 0 and no
+    // erase is needed until the ring wraps. A sector's magic is written
+    // after its first record, so a valid header implies a complete record.
+    constexpr uint32_t kRingSectorSize = 4096;
+    // "DRDR" in little-endian byte order.
+    constexpr uint32_t kRingMagic = 0x52445244u;
+    constexpr uint32_t kRingBitmapWords = 4;
+
+    struct RingHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t claimed[kRingBitmapWords]; // Bit clear: slot claimed.
+    };
+
+    constexpr uint32_t kRingSlotSize = sizeof(drd_handler::StateRecord);
+    constexpr uint32_t kRingSlotsFit =
+        (kRingSectorSize - sizeof(RingHeader)) / kRingSlotSize;
+    constexpr uint32_t kRingSlots = (kRingSlotsFit < kRingBitmapWords * 32)
+                                        ? kRingSlotsFit
+                                        : kRingBitmapWords * 32;
+
+    static_assert(kRingSlotSize % 4 == 0,
+                  "Flash ring slots must be word aligned");
+    static_assert(sizeof(RingHeader) % 4 == 0,
+                  "Flash ring header must be word aligned");
+
+    const esp_partition_t *s_ring_partition = nullptr;
+
+    uint32_t ring_slot_offset(uint32_t sector, uint32_t slot)
+    {
+        return sector * kRingSectorSize + sizeof(RingHeader) +
+               slot * kRingSlotSize;
+    }
+
+    // Slots are claimed in order, so the count is the number of trailing
+    // zero bits across the bitmap.
+    uint32_t ring_claimed(const RingHeader &header)
+    {
+        uint32_t count = 0;
+        for (const uint32_t word : header.claimed)
+        {
+            if (word != 0)
+            {
+                count += static_cast<uint32_t>(__builtin_ctz(word));
+                break;
+            }
+            count += 32;
+        }
+
+        return (count < kRingSlots) ? count : kRingSlots;
+    }
+#endif
+
+    uint32_t state_crc(const drd_handler::StateRecord &record)
+    {
+        return esp_rom_crc32_le(0,
+                                reinterpret_cast<const uint8_t *>(&record),
+                                offsetof(drd_handler::StateRecord, crc));
+    }
+
+    void seal_state(drd_handler::StateRecord &record)
+    {
+        record.magic = kStateMagic;
+        record.version = kStateVersion;
+        record.reserved = 0;
+        record.crc = state_crc(record);
+    }
+
+    bool state_valid(const drd_handler::StateRecord &record)
+    {
+        return record.magic == kStateMagic &&
+               record.version == kStateVersion &&
+               record.crc == state_crc(record);
+    }
+
+    bool slot_valid(const drd_handler::StateRecord &record)
+    {
+        return state_valid(record);
+    }
+
+#if defined(CONFIG_DRD_BACKEND_HYBRID)
+    bool slot_valid(const HybridRtcState &record)
+    {
+        return state_valid(record.state);
+    }
+#endif
+
+    // Index of the newest valid slot, or -1 if neither is valid.
+    template <typename Record>
+    int newest_slot(const RtcSlots<Record> &slots)
+    {
+        const bool valid0 = slot_valid(slots.slot[0]);
+        const bool valid1 = slot_valid(slots.slot[1]);
+        if (valid0 && valid1)
+        {
+            // Signed difference stays correct across the wrap.
+            return (static_cast<int32_t>(slots.sequence[1] -
+                                         slots.sequence[0]) > 0)
+                       ? 1
+                       : 0;
+        }
+        return valid0 ? 0 : (valid1 ? 1 : -1);
+    }
+
+    // Newest valid copy, or nullptr if neither slot holds one.
+    template <typename Record>
+    const Record *load_slot(const RtcSlots<Record> &slots)
+    {
+        const int newest = newest_slot(slots);
+        return (newest < 0) ? nullptr : &slots.slot[newest];
+    }
+
+    template <typename Record>
+    void store_slot(RtcSlots<Record> &slots, const Record &record)
+    {
+        const int newest = newest_slot(slots);
+        const int next = (newest == 0) ? 1 : 0;
+        const uint32_t sequence =
+            (newest < 0) ? 0 : slots.sequence[newest] + 1;
+
+        slots.slot[next] = record;
+        // Keep the compiler from publishing the sequence before the copy.
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        slots.sequence[next] = sequence;
+    }
+
+    template <typename Record>
+    void clear_slots(RtcSlots<Record> &slots)
+    {
+        slots.slot[0] = Record{};
+        slots.slot[1] = Record{};
+    }
+
+#if defined(CONFIG_DRD_WRITE_COALESCING)
+    // Whether writing @p record would change anything but its counters.
+    bool state_matches(const drd_handler::StateRecord &record,
+                       const drd_handler::StateRecord &stored)
+    {
+        return record.flags == stored.flags &&
+               record.taps == stored.taps &&
+               record.armed_at_ms == stored.armed_at_ms &&
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+               std::memcmp(record.channels,
+                           stored.channels,
+                           sizeof(record.channels)) == 0 &&
+#endif
+               std::memcmp(record.app_sha256,
+                           stored.app_sha256,
+                           sizeof(record.app_sha256)) == 0;
+    }
+#endif
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    // Version 2 records end at armed_at_ms, where they hold their CRC.
+    constexpr uint8_t kStateVersionV2 = 2;
+    constexpr size_t kStateSizeV2 =
+        offsetof(drd_handler::StateRecord, armed_at_ms) + sizeof(uint32_t);
+
+    // Upgrade a version 2 record read into a current-size buffer in place.
+    // Version 2 always held the full hash.
+    bool upgrade_v2_state(drd_handler::StateRecord &record, size_t len)
+    {
+        if (drd_handler::kIdentityLen != kSha256Len ||
+            len != kStateSizeV2 ||
+            record.magic != kStateMagic ||
+            record.version != kStateVersionV2)
+        {
+            return false;
+        }
+
+        const uint32_t crc_v2 = record.armed_at_ms;
+        if (crc_v2 != esp_rom_crc32_le(
+                          0,
+                          reinterpret_cast<const uint8_t *>(&record),
+                          offsetof(drd_handler::StateRecord, armed_at_ms)))
+        {
+            return false;
+        }
+
+        record.armed_at_ms = 0;
+        seal_state(record);
+        return true;
+    }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    // Records written without extra channels end where the channels
+    // start, and hold their CRC there.
+    constexpr size_t kStateSizeBase =
+        offsetof(drd_handler::StateRecord, channels) + sizeof(uint32_t);
+
+    // Give a record from a build without channels idle channels, in place.
+    bool upgrade_base_state(drd_handler::StateRecord &record, size_t len)
+    {
+        if (len != kStateSizeBase ||
+            record.magic != kStateMagic ||
+            record.version != kStateVersion)
+        {
+            return false;
+        }
+
+        uint32_t crc_base = 0;
+        std::memcpy(&crc_base, record.channels, sizeof(crc_base));
+        if (crc_base != esp_rom_crc32_le(
+                            0,
+                            reinterpret_cast<const uint8_t *>(&record),
+                            offsetof(drd_handler::StateRecord, channels)))
+        {
+            return false;
+        }
+
+        std::memset(record.channels, 0, sizeof(record.channels));
+        seal_state(record);
+        return true;
+    }
+#endif
+
+    // Record what NVS now holds, or nullptr when that is unknown.
+    void mirror_nvs_state(const drd_handler::StateRecord *record)
+    {
+#if defined(CONFIG_DRD_NVS_RTC_CACHE)
+        if (record != nullptr)
+        {
+            store_slot(s_nvs_mirror, *record);
+        }
+        else
+        {
+            clear_slots(s_nvs_mirror);
+        }
+#else
+        (void)record;
+#endif
+    }
+#endif
+
+    // Stamp the arm time for uptime-based detection.
+    void stamp_arm(drd_handler::StateRecord &record)
+    {
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+        record.armed_at_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+#else
+        (void)record;
+#endif
+    }
+
+    constexpr uint64_t kUsPerMs = 1000ULL;
+
+    // Window given in seconds, saturated instead of wrapping.
+    uint32_t seconds_to_ms(uint32_t seconds)
+    {
+        constexpr uint32_t kMaxSeconds = UINT32_MAX / 1000u;
+        return (seconds < kMaxSeconds) ? seconds * 1000u : UINT32_MAX;
+    }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    // Window of an extra channel, preferring the millisecond field.
+    uint32_t channel_window_ms(const drd_handler::ChannelConfig &config)
+    {
+        return (config.window_ms != 0) ? config.window_ms
+                                       : seconds_to_ms(config.window_s);
+    }
+#endif
 
-    bool is_tooling_reset(esp_reset_reason_t reason)
+    // Whether a sequence armed at @p armed_at_ms is still inside its
+    // window. Always true in timer mode, where a timer closes the window.
+    bool window_open_at(uint32_t armed_at_ms, uint32_t window_ms)
     {
-#if defined(CONFIG_DRD_SUPPRESS_TOOLING_RESETS)
-        return (reason == ESP_RST_SW) ||
-               (reason == ESP_RST_USB) ||
-               (reason == ESP_RST_JTAG);
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+        const esp_reset_reason_t reason = esp_reset_reason();
+        if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT)
+        {
+            // The RTC clock restarted, so the gap is unknown. Counting a
+            // single reset can miss a detection but never fakes one.
+            ESP_LOGI(TAG, "RTC clock restarted. DRD uptime gap unknown");
+            return false;
+        }
+
+        const uint32_t now_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+        // Unsigned subtraction stays correct across the 49-day wrap.
+        const uint32_t gap_ms = now_ms - armed_at_ms;
+
+        ESP_LOGI(TAG, "DRD uptime gap. gap_ms=%" PRIu32, gap_ms);
+
+        return gap_ms < window_ms;
 #else
-        (void)reason;
+        (void)armed_at_ms;
+        (void)window_ms;
+        return true;
+#endif
+    }
+
+    bool window_open(const drd_handler::StateRecord &record, uint32_t window_ms)
+    {
+        return window_open_at(record.armed_at_ms, window_ms);
+    }
+
+#if defined(DRD_HANDLER_HAS_NVS) || defined(CONFIG_DRD_BACKEND_FLASH)
+    // Arm flags of the primary sequence and of each extra channel, one bit
+    // each, so a store can tell whether it retracts a persisted one.
+    uint32_t armed_bits(const drd_handler::StateRecord &record)
+    {
+        uint32_t bits = ((record.flags & kFlagArmed) != 0) ? 1u : 0u;
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        for (uint8_t i = 0; i < drd_handler::kExtraChannels; ++i)
+        {
+            if ((record.channels[i].flags & kFlagArmed) != 0)
+            {
+                bits |= 2u << i;
+            }
+        }
+#endif
+        return bits;
+    }
+
+    // Whether storing @p record clears an arm flag that @p stored holds.
+    bool clears_arm(const drd_handler::StateRecord &stored,
+                    const drd_handler::StateRecord &record)
+    {
+        return (armed_bits(stored) & ~armed_bits(record)) != 0;
+    }
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+    // Whether storing @p record changes the tap count of a sequence that
+    // @p stored holds armed, on the primary sequence or any extra channel.
+    bool moves_taps(const drd_handler::StateRecord &stored,
+                    const drd_handler::StateRecord &record)
+    {
+        if ((stored.flags & kFlagArmed) != 0 && stored.taps != record.taps)
+        {
+            return true;
+        }
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        for (uint8_t i = 0; i < drd_handler::kExtraChannels; ++i)
+        {
+            if ((stored.channels[i].flags & kFlagArmed) != 0 &&
+                stored.channels[i].taps != record.channels[i].taps)
+            {
+                return true;
+            }
+        }
+#endif
         return false;
+    }
+#endif
+#endif
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    // Advance one extra channel for a boot with @p reason, the same way
+    // advance_taps() does for the primary sequence. Returns the tap count,
+    // or 0 when the reason does not count on the channel, and sets
+    // @p changed when the channel must be stored.
+    uint8_t step_channel(drd_handler::ChannelState &channel,
+                         const drd_handler::ChannelConfig &config,
+                         esp_reset_reason_t reason,
+                         bool &changed)
+    {
+        const uint32_t index = static_cast<uint32_t>(reason);
+        const bool counts =
+            index < 32 && (config.reset_mask & (1u << index)) != 0;
+        const bool armed = (channel.flags & kFlagArmed) != 0;
+
+        if (!counts)
+        {
+            if (armed)
+            {
+                channel = drd_handler::ChannelState{};
+                changed = true;
+            }
+            return 0;
+        }
+
+        uint8_t taps = 1;
+        if (armed &&
+            window_open_at(channel.armed_at_ms, channel_window_ms(config)))
+        {
+            const uint8_t prior = (channel.taps != 0) ? channel.taps : 1;
+            taps = (prior < config.max_taps) ? static_cast<uint8_t>(prior + 1)
+                                             : config.max_taps;
+        }
+
+        if (taps >= config.max_taps)
+        {
+            channel = drd_handler::ChannelState{};
+        }
+        else
+        {
+            channel.flags = kFlagArmed;
+            channel.taps = taps;
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+            channel.armed_at_ms =
+                static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+#endif
+        }
+
+        changed = true;
+        return taps;
+    }
 #endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    // "DRDH" in little-endian byte order.
+    constexpr uint32_t kHistoryMagic = 0x48445244u;
+    // HistoryRing::last_rtc_ms when no earlier evaluation time is known.
+    constexpr uint32_t kHistoryRtcUnknown = 0xFFFFFFFFu;
+
+    // Packed entry layout: reset reason in bits 0-4, policy action in 5-6,
+    // firmware dirty in 7, taps in 8-11 and the gap in seconds in 12-31.
+    constexpr uint32_t kHistReasonMask = 0x1Fu;
+    constexpr uint32_t kHistActionShift = 5;
+    constexpr uint32_t kHistDirtyBit = 1u << 7;
+    constexpr uint32_t kHistTapsShift = 8;
+    constexpr uint32_t kHistGapShift = 12;
+
+    static_assert(drd_handler::kMaxTaps <= 0xF,
+                  "History entries hold four bits of taps");
+
+    uint32_t history_crc(const HistoryRing &ring)
+    {
+        return esp_rom_crc32_le(0,
+                                reinterpret_cast<const uint8_t *>(&ring),
+                                offsetof(HistoryRing, crc));
     }
 
-    void sha256_to_hex(const uint8_t *sha,
-                       size_t len,
-                       char *out,
-                       size_t out_len)
+    bool history_valid(const HistoryRing &ring)
     {
-        if (out == nullptr || out_len == 0)
+        return ring.magic == kHistoryMagic &&
+               ring.count <= drd_handler::kHistoryLength &&
+               ring.head < drd_handler::kHistoryLength &&
+               ring.crc == history_crc(ring);
+    }
+
+    void seal_history(HistoryRing &ring)
+    {
+        ring.crc = history_crc(ring);
+    }
+
+    uint32_t pack_history(const drd_handler::HistoryEntry &entry)
+    {
+        const uint32_t gap = (entry.gap_s < drd_handler::kHistoryGapUnknown)
+                                 ? entry.gap_s
+                                 : drd_handler::kHistoryGapUnknown;
+
+        return (entry.reset_reason & kHistReasonMask) |
+               (static_cast<uint32_t>(entry.action) << kHistActionShift) |
+               (entry.firmware_dirty ? kHistDirtyBit : 0u) |
+               (static_cast<uint32_t>(entry.taps) << kHistTapsShift) |
+               (gap << kHistGapShift);
+    }
+
+    drd_handler::HistoryEntry unpack_history(uint32_t packed)
+    {
+        drd_handler::HistoryEntry entry{};
+        entry.reset_reason = static_cast<uint8_t>(packed & kHistReasonMask);
+        entry.action = static_cast<drd_handler::ResetAction>(
+            (packed >> kHistActionShift) & 0x3u);
+        entry.firmware_dirty = (packed & kHistDirtyBit) != 0;
+        entry.taps = static_cast<uint8_t>((packed >> kHistTapsShift) & 0xFu);
+        entry.gap_s = packed >> kHistGapShift;
+        return entry;
+    }
+
+    // Seconds since the previous entry, measured on the RTC clock.
+    uint32_t history_gap_s(const HistoryRing &ring, uint8_t reason)
+    {
+        if (ring.last_rtc_ms == kHistoryRtcUnknown ||
+            reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT)
+        {
+            return drd_handler::kHistoryGapUnknown;
+        }
+
+        const uint32_t now_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+        const uint32_t gap_s = (now_ms - ring.last_rtc_ms) / 1000u;
+        return (gap_s < drd_handler::kHistoryGapUnknown)
+                   ? gap_s
+                   : drd_handler::kHistoryGapUnknown - 1u;
+    }
+#endif
+
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+    // "DRDT" in little-endian byte order.
+    constexpr uint32_t kToolingMagic = 0x54445244u;
+    constexpr uint32_t kArmDelayMinMs = CONFIG_DRD_ARM_DELAY_MIN_MS;
+    constexpr uint32_t kArmDelayMaxMs =
+        static_cast<uint32_t>(CONFIG_DRD_ARM_DELAY_MAX_SECONDS) * 1000u;
+
+    static_assert(kArmDelayMinMs <= kArmDelayMaxMs,
+                  "DRD_ARM_DELAY_MIN_MS exceeds DRD_ARM_DELAY_MAX_SECONDS");
+
+    uint32_t tooling_crc(const ToolingTiming &timing)
+    {
+        return esp_rom_crc32_le(0,
+                                reinterpret_cast<const uint8_t *>(&timing),
+                                offsetof(ToolingTiming, crc));
+    }
+
+    void seal_tooling(ToolingTiming &timing)
+    {
+        timing.magic = kToolingMagic;
+        timing.reserved = 0;
+        timing.crc = tooling_crc(timing);
+    }
+
+    // Start over when RTC memory did not survive the reset.
+    void validate_tooling()
+    {
+        if (s_tooling.magic != kToolingMagic ||
+            s_tooling.crc != tooling_crc(s_tooling) ||
+            s_tooling.count > kToolingGaps || s_tooling.next >= kToolingGaps)
+        {
+            s_tooling = ToolingTiming{};
+        }
+    }
+
+    // Record the gap to this boot if the previous boot delayed arming and
+    // this reset came from tooling, then pick this boot's arm delay.
+    // Without recent gaps that is @p base_ms.
+    uint32_t tune_arm_delay(drd_handler::ResetAction action,
+                            uint32_t base_ms)
+    {
+        validate_tooling();
+
+        const uint32_t now_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+
+        if (s_tooling.pending != 0 &&
+            action == drd_handler::ResetAction::DelayArm)
+        {
+            // Gaps beyond the ceiling are not part of a burst.
+            const uint32_t gap_ms = now_ms - s_tooling.delayed_at_ms;
+            if (gap_ms <= kArmDelayMaxMs)
+            {
+                s_tooling.gaps_ms[s_tooling.next] = gap_ms;
+                s_tooling.next =
+                    static_cast<uint8_t>((s_tooling.next + 1) % kToolingGaps);
+                if (s_tooling.count < kToolingGaps)
+                {
+                    ++s_tooling.count;
+                }
+            }
+        }
+
+        s_tooling.pending = 0;
+        seal_tooling(s_tooling);
+
+        if (s_tooling.count == 0)
+        {
+            return base_ms;
+        }
+
+        // Twice the longest recent gap outlasts the next reset of a burst
+        // with some margin.
+        uint32_t longest_ms = 0;
+        for (uint8_t i = 0; i < s_tooling.count; ++i)
+        {
+            longest_ms = std::max(longest_ms, s_tooling.gaps_ms[i]);
+        }
+
+        const uint64_t delay_ms = static_cast<uint64_t>(longest_ms) * 2u;
+        return static_cast<uint32_t>(
+            std::clamp<uint64_t>(delay_ms, kArmDelayMinMs, kArmDelayMaxMs));
+    }
+
+    // Note that this boot delayed arming, so the next reset can be timed.
+    void note_arm_delay()
+    {
+        validate_tooling();
+        s_tooling.pending = 1;
+        s_tooling.delayed_at_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+        seal_tooling(s_tooling);
+    }
+#endif
+
+    // Count one more tap on an armed record. A full sequence disarms it;
+    // a shorter one stays armed with the window restarted from this boot.
+    uint8_t advance_taps(drd_handler::StateRecord &record)
+    {
+        constexpr uint8_t kMaxTaps = drd_handler::kMaxTaps;
+
+        // Records armed before tap counting existed hold taps == 0.
+        const uint8_t prior = (record.taps != 0) ? record.taps : 1;
+        const uint8_t taps =
+            (prior < kMaxTaps) ? static_cast<uint8_t>(prior + 1) : kMaxTaps;
+
+        if (taps >= kMaxTaps)
+        {
+            record.flags &= static_cast<uint8_t>(~kFlagArmed);
+            record.taps = 0;
+        }
+        else
+        {
+            record.taps = taps;
+            stamp_arm(record);
+        }
+
+        return taps;
+    }
+
+    // Outcome of one boot of the RTC state machine.
+    struct UntrackedStep
+    {
+        uint8_t taps = 1;
+        // Store context when the record changed, nullptr otherwise.
+        const char *context = nullptr;
+        // Whether a disarm timer must close the window once stored.
+        bool open_window = false;
+        // Final count of a sequence this boot ended, 0 if none.
+        uint8_t closed_taps = 0;
+    };
+
+    // Advance a record without firmware tracking. Needs no timer, task or
+    // flash access, so it can run before app_main. There is no arm delay
+    // without firmware tracking, so DelayArm behaves like Clear.
+    UntrackedStep step_untracked(drd_handler::StateRecord &record,
+                                 drd_handler::ResetAction action,
+                                 uint32_t window_ms)
+    {
+        UntrackedStep step;
+        const bool armed = (record.flags & kFlagArmed) != 0;
+
+        if (action != drd_handler::ResetAction::Count)
+        {
+            if (armed)
+            {
+                step.closed_taps = (record.taps != 0) ? record.taps : 1;
+                record.flags &= static_cast<uint8_t>(~kFlagArmed);
+                record.taps = 0;
+                step.context = "reset policy clear";
+            }
+
+            return step;
+        }
+
+        if (armed && window_open(record, window_ms))
+        {
+            step.taps = advance_taps(record);
+            step.context = "detection";
+            step.open_window = (step.taps < drd_handler::kMaxTaps);
+            step.closed_taps = step.open_window ? 0 : step.taps;
+            ESP_LOGI(TAG,
+                     "Multi-reset detected using RTC backend. taps=%u",
+                     static_cast<unsigned>(step.taps));
+            return step;
+        }
+
+        ESP_LOGI(TAG,
+                 "Arming RTC double-reset window. window_ms=%" PRIu32,
+                 window_ms);
+        record.flags |= kFlagArmed;
+        record.taps = 1;
+        stamp_arm(record);
+        step.context = "arming";
+        step.open_window = true;
+        return step;
+    }
+
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+    // Outcome of the pre-app_main evaluation. Kept in DRAM rather than
+    // RTC memory: it is zeroed on every boot before the hook runs, so a
+    // result from an earlier boot can never be adopted.
+    struct EarlyResult
+    {
+        bool valid = false;
+        UntrackedStep step;
+    };
+
+    EarlyResult s_early;
+#endif
+
+#if defined(CONFIG_DRD_ENABLE_STATS)
+    drd_handler::Stats s_stats;
+
+    /// Adds the lifetime of the scope to an accumulator.
+    class StatsScope
+    {
+    public:
+        explicit StatsScope(int64_t &elapsed_us)
+            : elapsed_us_(elapsed_us), start_us_(esp_timer_get_time())
+        {
+        }
+
+        ~StatsScope()
+        {
+            elapsed_us_ += esp_timer_get_time() - start_us_;
+        }
+
+        StatsScope(const StatsScope &) = delete;
+        StatsScope &operator=(const StatsScope &) = delete;
+
+    private:
+        int64_t &elapsed_us_;
+        int64_t start_us_;
+    };
+
+#define DRD_STATS_PART(time_field) \
+    StatsScope drd_stats_scope(s_stats.time_field)
+#define DRD_STATS_COUNT(count_field) ++s_stats.count_field
+#else
+#define DRD_STATS_PART(time_field) (void)0
+#define DRD_STATS_COUNT(count_field) (void)0
+#endif
+
+#if defined(CONFIG_DRD_TRACE)
+    // SystemView user event ids, one per traced phase and named after the
+    // Stats field that times it. The Flash backend's partition calls share
+    // the read and write ids.
+    constexpr unsigned kTraceIdBase = CONFIG_DRD_TRACE_ID_BASE;
+    constexpr unsigned kTrace_configure_us = kTraceIdBase + 0;
+    constexpr unsigned kTrace_check_us = kTraceIdBase + 1;
+    constexpr unsigned kTrace_nvs_init_us = kTraceIdBase + 2;
+    constexpr unsigned kTrace_nvs_open_us = kTraceIdBase + 3;
+    constexpr unsigned kTrace_nvs_read_us = kTraceIdBase + 4;
+    constexpr unsigned kTrace_nvs_write_us = kTraceIdBase + 5;
+    constexpr unsigned kTrace_nvs_commit_us = kTraceIdBase + 6;
+    constexpr unsigned kTrace_timer_create_us = kTraceIdBase + 7;
+    constexpr unsigned kTrace_timer_cb = kTraceIdBase + 8;
+
+    /// Marks the lifetime of the scope as a SystemView user event.
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(unsigned id) : id_(id)
+        {
+            SEGGER_SYSVIEW_OnUserStart(id_);
+        }
+
+        ~TraceScope()
+        {
+            SEGGER_SYSVIEW_OnUserStop(id_);
+        }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        unsigned id_;
+    };
+
+#define DRD_TRACE_PART(phase) TraceScope drd_trace_scope(kTrace_##phase)
+#else
+#define DRD_TRACE_PART(phase) (void)0
+#endif
+
+// Time and trace the enclosing scope; nothing when both are off.
+#define DRD_STATS_SCOPE(time_field) \
+    DRD_STATS_PART(time_field);     \
+    DRD_TRACE_PART(time_field)
+
+#if defined(CONFIG_DRD_ENABLE_STATS) || defined(CONFIG_DRD_TRACE)
+// Time, trace and count a call; the plain call when both are off.
+#define DRD_TIMED(time_field, count_field, call) \
+    [&]() {                                      \
+        DRD_STATS_SCOPE(time_field);             \
+        DRD_STATS_COUNT(count_field);            \
+        return (call);                           \
+    }()
+#else
+#define DRD_TIMED(time_field, count_field, call) (call)
+#endif
+
+    using drd_handler::ResetAction;
+
+    // Reset reason policy of @p Config, one bit per esp_reset_reason_t.
+    template <const drd_handler::DrdConfig &Config>
+    ResetAction reset_action(esp_reset_reason_t reason)
+    {
+        // Overlaps are resolved here so each reason lands in exactly one
+        // mask.
+        constexpr uint32_t kIgnoreMask = Config.ignore_mask;
+        constexpr uint32_t kDelayArmMask =
+            Config.delay_arm_mask & ~kIgnoreMask;
+        constexpr uint32_t kClearMask =
+            Config.clear_mask & ~(kIgnoreMask | kDelayArmMask);
+        constexpr uint32_t kPolicyMask =
+            kIgnoreMask | kDelayArmMask | kClearMask;
+
+        const uint32_t bit = (static_cast<uint32_t>(reason) < 32)
+                                 ? (1u << static_cast<uint32_t>(reason))
+                                 : 0;
+
+        // User resets are the common case and cost one test.
+        if ((bit & kPolicyMask) == 0)
+        {
+            return ResetAction::Count;
+        }
+
+        if ((bit & kIgnoreMask) != 0)
+        {
+            return ResetAction::Ignore;
+        }
+
+        return ((bit & kDelayArmMask) != 0) ? ResetAction::DelayArm
+                                            : ResetAction::Clear;
+    }
+
+    void sha256_to_hex(const uint8_t *sha,
+                       size_t len,
+                       char *out,
+                       size_t out_len)
+    {
+        if (out == nullptr || out_len == 0)
+        {
+            return;
+        }
+
+        if (sha == nullptr || len == 0)
+        {
+            out[0] = '\0';
+            return;
+        }
+
+        static const char *hex = "0123456789abcdef";
+        const size_t needed = (len * 2U) + 1U;
+
+        if (out_len < needed)
+        {
+            out[0] = '\0';
+            return;
+        }
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            const uint8_t v = sha[i];
+            out[(i * 2U) + 0U] = hex[(v >> 4) & 0x0F];
+            out[(i * 2U) + 1U] = hex[v & 0x0F];
+        }
+
+        out[len * 2U] = '\0';
+    }
+
+    // Kept out of line so the hex buffer only occupies stack when a hash is
+    // actually printed.
+    __attribute__((noinline)) void log_sha256(const char *label,
+                                              const uint8_t *sha,
+                                              size_t len)
+    {
+        if (esp_log_level_get(TAG) < ESP_LOG_INFO)
+        {
+            return;
+        }
+
+        char hex[(kSha256Len * 2U) + 1U] = {};
+        sha256_to_hex(sha, len, hex, sizeof(hex));
+        ESP_LOGI(TAG, "DRD %s app SHA-256: %s", label, hex);
+    }
+
+    bool get_current_app_sha256(
+        std::array<uint8_t, kSha256Len> &out)
+    {
+        const esp_app_desc_t *app = esp_app_get_description();
+        if (app == nullptr)
+        {
+            return false;
+        }
+
+        std::memcpy(out.data(), app->app_elf_sha256, kSha256Len);
+        return true;
+    }
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    esp_err_t safe_nvs_init(const char *partition)
+    {
+        // nvs_flash_init() also applies the NVS encryption settings of the
+        // default partition, so it is kept for that partition.
+        const esp_err_t err =
+            (std::strcmp(partition, NVS_DEFAULT_PART_NAME) == 0)
+                ? nvs_flash_init()
+                : nvs_flash_init_partition(partition);
+
+        if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
+            err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+        {
+            ESP_LOGW(TAG,
+                     "NVS init of partition '%s' reported no free pages or "
+                     "new version. Skipping erase. err=%s",
+                     partition,
+                     esp_err_to_name(err));
+        }
+
+        return err;
+    }
+#endif
+
+    const char *reset_reason_to_string(esp_reset_reason_t reason)
+    {
+        switch (reason)
+        {
+        case ESP_RST_POWERON:
+            return "Power-on reset";
+        case ESP_RST_EXT:
+            return "External pin reset";
+        case ESP_RST_SW:
+            return "Software reset";
+        case ESP_RST_PANIC:
+            return "Panic reset";
+        case ESP_RST_INT_WDT:
+            return "Interrupt watchdog reset";
+        case ESP_RST_TASK_WDT:
+            return "Task watchdog reset";
+        case ESP_RST_WDT:
+            return "Other watchdog reset";
+        case ESP_RST_DEEPSLEEP:
+            return "Deep-sleep wakeup";
+        case ESP_RST_BROWNOUT:
+            return "Brownout reset";
+        case ESP_RST_SDIO:
+            return "SDIO reset";
+        case ESP_RST_USB:
+            return "USB reset";
+        case ESP_RST_JTAG:
+            return "JTAG reset";
+        default:
+            return "Unknown reset reason";
+        }
+    }
+
+    // BasicDetector::result_ layout: the tap count in the low byte and
+    // the evaluation state above it. Only kResultDone is ever observed
+    // outside the lock.
+    constexpr uint32_t kResultTapsMask = 0xFFu;
+    constexpr uint32_t kResultIdle = 0;
+    constexpr uint32_t kResultBusy = 1u << 8;
+    constexpr uint32_t kResultDone = 1u << 9;
+
+    // Holds a recursive FreeRTOS mutex for the enclosing scope.
+    class LockGuard
+    {
+    public:
+        explicit LockGuard(SemaphoreHandle_t mutex) : mutex_(mutex)
+        {
+            (void)xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+        }
+
+        ~LockGuard()
+        {
+            (void)xSemaphoreGiveRecursive(mutex_);
+        }
+
+        LockGuard(const LockGuard &) = delete;
+        LockGuard &operator=(const LockGuard &) = delete;
+
+    private:
+        SemaphoreHandle_t mutex_;
+    };
+
+} // namespace
+
+namespace drd_handler
+{
+    RtcStorage::RtcStorage(const char *nvs_namespace,
+                           const char *nvs_partition)
+    {
+        (void)nvs_namespace;
+        (void)nvs_partition;
+    }
+
+    esp_err_t RtcStorage::open()
+    {
+        ESP_LOGI(TAG, "DRD using RTC backend");
+        return ESP_OK;
+    }
+
+    esp_err_t RtcStorage::load(StateRecord &record)
+    {
+        const StateRecord *stored = load_slot(s_rtc_record);
+        if (stored == nullptr)
+        {
+            record = StateRecord{};
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        record = *stored;
+        return ESP_OK;
+    }
+
+    esp_err_t RtcStorage::store(StateRecord &record, const char *context)
+    {
+        (void)context;
+
+        seal_state(record);
+        store_slot(s_rtc_record, record);
+        return ESP_OK;
+    }
+
+    esp_err_t RtcStorage::erase()
+    {
+        clear_slots(s_rtc_record);
+        ESP_LOGI(TAG, "RTC double-reset flag cleared");
+        return ESP_OK;
+    }
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    NvsStorage::NvsStorage(const char *nvs_namespace,
+                           const char *nvs_partition)
+        : nvs_namespace_(nvs_namespace ? nvs_namespace : "drd"),
+          nvs_partition_(nvs_partition ? nvs_partition : kNvsPartition)
+    {
+    }
+
+    NvsStorage::~NvsStorage()
+    {
+        if (ready_ && owns_handle_)
+        {
+            nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+            nvs_close(h);
+        }
+
+        ready_ = false;
+        handle_ = 0;
+        owns_handle_ = false;
+    }
+
+    esp_err_t NvsStorage::open()
+    {
+        if (ready_)
+        {
+            return ESP_OK;
+        }
+
+        esp_err_t err = ESP_OK;
+        {
+            DRD_STATS_SCOPE(nvs_init_us);
+            err = safe_nvs_init(nvs_partition_);
+        }
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "NVS init failed in configure(). err=%s",
+                     esp_err_to_name(err));
+        }
+
+        nvs_handle_t h = 0;
+        {
+            DRD_STATS_SCOPE(nvs_open_us);
+            err = nvs_open_from_partition(nvs_partition_,
+                                          nvs_namespace_,
+                                          NVS_READWRITE,
+                                          &h);
+        }
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_open('%s') failed. partition='%s', err=%s",
+                     nvs_namespace_,
+                     nvs_partition_,
+                     esp_err_to_name(err));
+            ready_ = false;
+            handle_ = 0;
+            return err;
+        }
+
+        ready_ = true;
+        handle_ = static_cast<uint32_t>(h);
+        owns_handle_ = true;
+
+        ESP_LOGI(TAG,
+                 "DRD using NVS backend. partition='%s', namespace='%s'",
+                 nvs_partition_,
+                 nvs_namespace_);
+        return ESP_OK;
+    }
+
+    esp_err_t NvsStorage::adopt(uint32_t handle)
+    {
+        if (ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        ready_ = true;
+        handle_ = handle;
+        owns_handle_ = false;
+
+        ESP_LOGI(TAG, "DRD using NVS backend. Application-owned handle");
+        return ESP_OK;
+    }
+
+    esp_err_t NvsStorage::load(StateRecord &record)
+    {
+        migrated_ = false;
+        persisted_valid_ = false;
+        record = StateRecord{};
+
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+#if defined(CONFIG_DRD_NVS_RTC_CACHE)
+        // DRD is the only writer of its namespace, so a valid mirror
+        // matches NVS and the read can be skipped.
+        if (const StateRecord *mirror = load_slot(s_nvs_mirror))
+        {
+            ESP_LOGD(TAG, "DRD state taken from RTC mirror of NVS");
+            record = *mirror;
+            persisted_ = *mirror;
+            persisted_valid_ = true;
+            return ESP_OK;
+        }
+#endif
+
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+
+        StateRecord stored{};
+        size_t len = sizeof(stored);
+
+        const esp_err_t err =
+            DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_blob(h, kKeyState, &stored, &len));
+        if (err == ESP_ERR_NVS_NOT_FOUND)
+        {
+            // Legacy per-key state is only consulted when no record exists.
+            if (migrate_legacy(record) != ESP_OK)
+            {
+                return err;
+            }
+
+            migrated_ = true;
+            return ESP_OK;
+        }
+
+        if (err == ESP_OK && upgrade_v2_state(stored, len))
+        {
+            ESP_LOGI(TAG, "Upgraded DRD state record from version 2");
+            len = sizeof(stored);
+        }
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        else if (err == ESP_OK && upgrade_base_state(stored, len))
+        {
+            ESP_LOGI(TAG, "Added DRD channels to the stored state record");
+            len = sizeof(stored);
+        }
+#endif
+
+        if (err != ESP_OK || len != sizeof(stored))
+        {
+            ESP_LOGW(TAG,
+                     "nvs_get_blob(state) failed or size mismatch. "
+                     "Discarding DRD state. err=%s, len=%u",
+                     esp_err_to_name(err),
+                     static_cast<unsigned>(len));
+            return (err != ESP_OK) ? err : ESP_ERR_INVALID_SIZE;
+        }
+
+        if (!state_valid(stored))
+        {
+            ESP_LOGW(TAG,
+                     "Stored DRD state failed validation. Discarding. "
+                     "version=%u",
+                     static_cast<unsigned>(stored.version));
+            return ESP_ERR_INVALID_CRC;
+        }
+
+        record = stored;
+        persisted_ = stored;
+        persisted_valid_ = true;
+        mirror_nvs_state(&stored);
+        return ESP_OK;
+    }
+
+    esp_err_t NvsStorage::migrate_legacy(StateRecord &record)
+    {
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+
+        record = StateRecord{};
+        bool found = false;
+
+        uint8_t legacy_sha[kSha256Len] = {};
+        size_t sha_len = sizeof(legacy_sha);
+        const esp_err_t err_sha =
+            DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_blob(h,
+                                   kKeyAppSha256,
+                                   legacy_sha,
+                                   &sha_len));
+
+        if (err_sha == ESP_OK && sha_len == kSha256Len)
+        {
+            std::memcpy(record.app_sha256,
+                        legacy_sha,
+                        sizeof(record.app_sha256));
+            record.magic = kStateMagic;
+            found = true;
+        }
+        else
+        {
+            found = (err_sha != ESP_ERR_NVS_NOT_FOUND);
+        }
+
+        uint32_t legacy_hash = 0;
+        found |= (DRD_TIMED(nvs_read_us, nvs_reads,
+                            nvs_get_u32(h, kKeyAppHash, &legacy_hash)) == ESP_OK);
+
+        uint8_t value = 0;
+        const esp_err_t err_dirty =
+            DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_u8(h, kKeyDirty, &value));
+        if (err_dirty == ESP_OK)
+        {
+            found = true;
+            if (value != 0)
+            {
+                record.flags |= kFlagDirty;
+            }
+        }
+        else if (err_dirty != ESP_ERR_NVS_NOT_FOUND)
+        {
+            // Matches the old read path, which assumed dirty on error.
+            record.flags |= kFlagDirty;
+        }
+
+        if (DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_u8(h, kKeyFirstBoot, &value)) == ESP_OK)
+        {
+            found = true;
+            if (value != 0)
+            {
+                record.flags |= kFlagFirstBoot;
+            }
+        }
+
+        uint32_t magic = 0;
+        if (DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_u32(h, kKeyMagic, &magic)) == ESP_OK)
+        {
+            found = true;
+            if (magic == kDrdMagic)
+            {
+                record.flags |= kFlagArmed;
+            }
+        }
+
+        if (!found)
+        {
+            record = StateRecord{};
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        ESP_LOGI(TAG, "Migrating legacy DRD keys to packed state record");
+
+        // Erasures are committed together with the new record.
+        const char *keys[] = {
+            kKeyMagic,
+            kKeyBoot,
+            kKeyDirty,
+            kKeyFirstBoot,
+            kKeyAppSha256,
+            kKeyAppHash,
+        };
+
+        for (const char *key : keys)
+        {
+            const esp_err_t err =
+                DRD_TIMED(nvs_write_us, nvs_writes,
+                          nvs_erase_key(h, key));
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            {
+                ESP_LOGW(TAG,
+                         "nvs_erase_key('%s') during migration failed. "
+                         "err=%s",
+                         key,
+                         esp_err_to_name(err));
+            }
+        }
+
+        return ESP_OK;
+    }
+
+    esp_err_t NvsStorage::store(StateRecord &record, const char *context)
+    {
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        // Clearing a persisted arm flag is always allowed. Skipping it would
+        // leave a stale marker that the next boot reads as a double reset.
+        const bool retracts_arm =
+            persisted_valid_ && clears_arm(persisted_, record);
+
+#if defined(CONFIG_DRD_WRITE_COALESCING)
+        // Counters alone never justify a flash write.
+        if (persisted_valid_ && state_matches(record, persisted_))
+        {
+            ESP_LOGD(TAG,
+                     "DRD state unchanged during %s. Skipping write",
+                     context);
+            record.boot_count = persisted_.boot_count;
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+            // NVS already holds this state, so a staged change is void.
+            if (staged_valid_)
+            {
+                record.write_count = persisted_.write_count;
+                staged_valid_ = false;
+            }
+#endif
+            return ESP_OK;
+        }
+#endif
+
+        if (kMaxWritesPerBoot != 0 &&
+            writes_this_boot_ >= kMaxWritesPerBoot &&
+            !retracts_arm)
+        {
+            ESP_LOGW(TAG,
+                     "DRD write budget exhausted. Skipping write during %s. "
+                     "writes=%" PRIu32,
+                     context,
+                     writes_this_boot_);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        // Retracting the arm or advancing an armed sequence is written
+        // through. Losing either to a reset before flush() would fake a
+        // detection, or dispatch the wrong tap count, on the next boot.
+        const bool settles_taps =
+            retracts_arm ||
+            (persisted_valid_ && moves_taps(persisted_, record));
+        if (defer_ && !settles_taps)
+        {
+            // Restaging replaces a record that already took its increment.
+            if (!staged_valid_)
+            {
+                ++record.write_count;
+            }
+            seal_state(record);
+            staged_ = record;
+            staged_valid_ = true;
+            return ESP_OK;
+        }
+
+        if (staged_valid_)
+        {
+            // This write supersedes the staged record and its increment.
+            staged_valid_ = false;
+        }
+        else
+        {
+            ++record.write_count;
+        }
+#else
+        ++record.write_count;
+#endif
+        seal_state(record);
+
+        return write_record(record, context, true);
+    }
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+    esp_err_t NvsStorage::flush()
+    {
+        if (!staged_valid_)
+        {
+            return ESP_OK;
+        }
+
+        staged_valid_ = false;
+        return write_record(staged_, "flush", owns_handle_);
+    }
+#endif
+
+    esp_err_t NvsStorage::write_record(const StateRecord &record,
+                                       const char *context,
+                                       bool commit)
+    {
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+
+        ++writes_this_boot_;
+
+        // Until the commit is known to have landed, NVS content is unknown.
+        mirror_nvs_state(nullptr);
+
+        esp_err_t err =
+            DRD_TIMED(nvs_write_us, nvs_writes,
+                      nvs_set_blob(h, kKeyState, &record, sizeof(record)));
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_set_blob(state) failed during %s. err=%s",
+                     context,
+                     esp_err_to_name(err));
+            return err;
+        }
+
+        err = commit ? DRD_TIMED(nvs_commit_us, nvs_commits, nvs_commit(h))
+                     : ESP_OK;
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_commit() failed during %s. err=%s",
+                     context,
+                     esp_err_to_name(err));
+            return err;
+        }
+
+        migrated_ = false;
+        persisted_ = record;
+        persisted_valid_ = true;
+        mirror_nvs_state(&record);
+        return ESP_OK;
+    }
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    esp_err_t NvsStorage::load_history(void *data, size_t len)
+    {
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+        size_t stored = len;
+
+        const esp_err_t err =
+            DRD_TIMED(nvs_read_us, nvs_reads,
+                      nvs_get_blob(h, kKeyHistory, data, &stored));
+        if (err != ESP_OK)
+        {
+            if (err != ESP_ERR_NVS_NOT_FOUND)
+            {
+                ESP_LOGW(TAG,
+                         "nvs_get_blob(history) failed. err=%s",
+                         esp_err_to_name(err));
+            }
+            return err;
+        }
+
+        // A blob from a build with another history length is discarded.
+        return (stored == len) ? ESP_OK : ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t NvsStorage::store_history(const void *data, size_t len)
+    {
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+
+        esp_err_t err = DRD_TIMED(nvs_write_us, nvs_writes,
+                                  nvs_set_blob(h, kKeyHistory, data, len));
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_set_blob(history) failed. err=%s",
+                     esp_err_to_name(err));
+            return err;
+        }
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        // Only flush() writes the history here, so it follows the record.
+        const bool commit = owns_handle_;
+#else
+        const bool commit = true;
+#endif
+        err = commit ? DRD_TIMED(nvs_commit_us, nvs_commits, nvs_commit(h))
+                     : ESP_OK;
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_commit() failed for history. err=%s",
+                     esp_err_to_name(err));
+        }
+
+        return err;
+    }
+#endif
+
+    esp_err_t NvsStorage::erase()
+    {
+        const esp_err_t err_open = open();
+        if (err_open != ESP_OK)
+        {
+            ESP_LOGW(TAG, "clear_flag called but NVS is not ready");
+            return err_open;
+        }
+
+        nvs_handle_t h = static_cast<nvs_handle_t>(handle_);
+
+        const char *keys[] = {
+            kKeyState,
+            kKeyMagic,
+            kKeyBoot,
+            kKeyDirty,
+            kKeyFirstBoot,
+            kKeyAppSha256,
+            kKeyAppHash,
+        };
+
+        migrated_ = false;
+        persisted_valid_ = false;
+        mirror_nvs_state(nullptr);
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        staged_valid_ = false;
+#endif
+
+        for (const char *key : keys)
+        {
+            const esp_err_t err =
+                DRD_TIMED(nvs_write_us, nvs_writes,
+                          nvs_erase_key(h, key));
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            {
+                ESP_LOGW(TAG,
+                         "nvs_erase_key('%s') failed. err=%s",
+                         key,
+                         esp_err_to_name(err));
+            }
+        }
+
+        const esp_err_t err_commit =
+            DRD_TIMED(nvs_commit_us, nvs_commits, nvs_commit(h));
+        if (err_commit != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "nvs_commit() in clear_flag failed. err=%s",
+                     esp_err_to_name(err_commit));
+            return err_commit;
+        }
+
+        ESP_LOGI(TAG, "NVS double-reset flag cleared");
+        return ESP_OK;
+    }
+
+    void NvsStorage::assume_persisted(const StateRecord *record)
+    {
+        persisted_valid_ = (record != nullptr);
+        persisted_ = persisted_valid_ ? *record : StateRecord{};
+    }
+
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_HYBRID)
+    HybridStorage::HybridStorage(const char *nvs_namespace,
+                                 const char *nvs_partition)
+        : nvs_(nvs_namespace, nvs_partition)
+    {
+    }
+
+    esp_err_t HybridStorage::open()
+    {
+        rtc_sourced_ = load_slot(s_rtc_state) != nullptr;
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        // Opening NVS allocates, so it cannot wait for a retraction. The
+        // RTC state is still usable if it fails.
+        if (rtc_sourced_)
+        {
+            ESP_LOGI(TAG,
+                     "DRD using Hybrid backend. RTC state valid, "
+                     "opening NVS for static allocation");
+            (void)nvs_.open();
+            return ESP_OK;
+        }
+#else
+        if (rtc_sourced_)
+        {
+            // NVS is opened lazily, only if a stored arm flag must be
+            // cleared.
+            ESP_LOGI(TAG,
+                     "DRD using Hybrid backend. RTC state valid, "
+                     "NVS not needed");
+            return ESP_OK;
+        }
+#endif
+
+        ESP_LOGI(TAG,
+                 "DRD using Hybrid backend. RTC state invalid, "
+                 "falling back to NVS");
+        return nvs_.open();
+    }
+
+    esp_err_t HybridStorage::load(StateRecord &record)
+    {
+        if (rtc_sourced_)
+        {
+            const HybridRtcState *stored = load_slot(s_rtc_state);
+            record = stored->state;
+            nvs_.assume_persisted(state_valid(stored->nvs) ? &stored->nvs
+                                                           : nullptr);
+            return ESP_OK;
+        }
+
+        const esp_err_t err = nvs_.load(record);
+
+        // Mirror NVS-sourced state even when nothing is written later, so
+        // the next soft reset can skip NVS.
+        if (err == ESP_OK && !nvs_.pending_write())
+        {
+            const StateRecord *persisted = nvs_.persisted();
+            store_slot(s_rtc_state,
+                       HybridRtcState{record,
+                                      persisted ? *persisted : StateRecord{}});
+        }
+
+        return err;
+    }
+
+    esp_err_t HybridStorage::store(StateRecord &record, const char *context)
+    {
+        esp_err_t err = ESP_OK;
+
+        if (!rtc_sourced_)
+        {
+            err = nvs_.open();
+            if (err == ESP_OK)
+            {
+                err = nvs_.store(record, context);
+            }
+        }
+        else
+        {
+            // RTC-sourced boots only write NVS to retract an arm flag that
+            // an earlier NVS-sourced boot left there, or to record that the
+            // current firmware became clean. A stale identity in NVS already
+            // reads as dirty after power loss, so dirty records stay in RTC.
+            const StateRecord *stored = nvs_.persisted();
+            const bool retracts_arm =
+                stored != nullptr && clears_arm(*stored, record);
+            const bool clean_unsaved =
+                (record.flags & kFlagDirty) == 0 &&
+                (stored == nullptr ||
+                 (stored->flags & kFlagDirty) != 0 ||
+                 std::memcmp(stored->app_sha256,
+                             record.app_sha256,
+                             sizeof(record.app_sha256)) != 0);
+
+            if (retracts_arm || clean_unsaved)
+            {
+                // The arm flag stays in RTC, so NVS never needs a later
+                // write to retract it.
+                StateRecord durable = record;
+                durable.flags &= static_cast<uint8_t>(~kFlagArmed);
+                durable.taps = 0;
+                durable.armed_at_ms = 0;
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+                std::memset(durable.channels, 0, sizeof(durable.channels));
+#endif
+
+                err = nvs_.open();
+                if (err == ESP_OK)
+                {
+                    err = nvs_.store(durable, context);
+                }
+                record.write_count = durable.write_count;
+            }
+        }
+
+        seal_state(record);
+
+        const StateRecord *persisted = nvs_.persisted();
+        store_slot(s_rtc_state,
+                   HybridRtcState{record,
+                                  persisted ? *persisted : StateRecord{}});
+        return err;
+    }
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    esp_err_t HybridStorage::load_history(void *data, size_t len)
+    {
+        const esp_err_t err = nvs_.open();
+        return (err == ESP_OK) ? nvs_.load_history(data, len) : err;
+    }
+
+    esp_err_t HybridStorage::store_history(const void *data, size_t len)
+    {
+        const esp_err_t err = nvs_.open();
+        return (err == ESP_OK) ? nvs_.store_history(data, len) : err;
+    }
+#endif
+
+    esp_err_t HybridStorage::erase()
+    {
+        // Invalidate both copies so the next boot falls back to NVS.
+        clear_slots(s_rtc_state);
+        rtc_sourced_ = false;
+
+        return nvs_.erase();
+    }
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_FLASH)
+    FlashRingStorage::FlashRingStorage(const char *nvs_namespace,
+                                       const char *nvs_partition)
+    {
+        (void)nvs_namespace;
+        (void)nvs_partition;
+    }
+
+    esp_err_t FlashRingStorage::open()
+    {
+        if (ready_)
+        {
+            return ESP_OK;
+        }
+
+        s_ring_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                    ESP_PARTITION_SUBTYPE_ANY,
+                                                    kRingPartition);
+        if (s_ring_partition == nullptr)
+        {
+            ESP_LOGW(TAG,
+                     "DRD flash partition '%s' not found",
+                     kRingPartition);
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        // A wrap erases the sector after the current one, which on a
+        // single sector is the one holding the live record.
+        sectors_ = s_ring_partition->size / kRingSectorSize;
+        if (sectors_ < 2)
+        {
+            ESP_LOGW(TAG,
+                     "DRD flash partition '%s' is smaller than two sectors",
+                     kRingPartition);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        // One header read per sector finds the newest sector and, from
+        // its bitmap, the newest slot.
+        empty_ = true;
+        for (uint32_t sector = 0; sector < sectors_; ++sector)
+        {
+            RingHeader header{};
+            const esp_err_t err =
+                DRD_TIMED(nvs_read_us, nvs_reads,
+                          esp_partition_read(s_ring_partition,
+                                             sector * kRingSectorSize,
+                                             &header,
+                                             sizeof(header)));
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG,
+                         "esp_partition_read(header) failed. sector=%" PRIu32
+                         ", err=%s",
+                         sector,
+                         esp_err_to_name(err));
+                return err;
+            }
+
+            if (header.magic != kRingMagic)
+            {
+                continue;
+            }
+
+            // Sequence numbers are compared with wraparound.
+            if (empty_ ||
+                static_cast<int32_t>(header.sequence - sequence_) > 0)
+            {
+                empty_ = false;
+                sector_ = sector;
+                sequence_ = header.sequence;
+                claimed_ = ring_claimed(header);
+            }
+        }
+
+        ready_ = true;
+
+        ESP_LOGI(TAG,
+                 "DRD using flash backend. partition='%s', sectors=%" PRIu32
+                 ", slots=%" PRIu32,
+                 kRingPartition,
+                 sectors_,
+                 kRingSlots);
+        return ESP_OK;
+    }
+
+    esp_err_t FlashRingStorage::load(StateRecord &record)
+    {
+        persisted_valid_ = false;
+        record = StateRecord{};
+
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        if (empty_)
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        // A claimed slot whose write was cut short fails validation, so
+        // the slot before it holds the newest complete record.
+        for (uint32_t slot = claimed_; slot-- > 0;)
+        {
+            StateRecord stored{};
+            const esp_err_t err =
+                DRD_TIMED(nvs_read_us, nvs_reads,
+                          esp_partition_read(s_ring_partition,
+                                             ring_slot_offset(sector_, slot),
+                                             &stored,
+                                             sizeof(stored)));
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG,
+                         "esp_partition_read(record) failed. err=%s",
+                         esp_err_to_name(err));
+                return err;
+            }
+
+            if (state_valid(stored))
+            {
+                record = stored;
+                persisted_ = stored;
+                persisted_valid_ = true;
+                return ESP_OK;
+            }
+
+            ESP_LOGW(TAG,
+                     "Flash DRD record failed validation. slot=%" PRIu32,
+                     slot);
+        }
+
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    esp_err_t FlashRingStorage::store(StateRecord &record, const char *context)
+    {
+        if (!ready_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        // Clearing a persisted arm flag is always allowed, as for NVS.
+        const bool retracts_arm =
+            persisted_valid_ && clears_arm(persisted_, record);
+
+#if defined(CONFIG_DRD_WRITE_COALESCING)
+        if (persisted_valid_ && state_matches(record, persisted_))
+        {
+            ESP_LOGD(TAG,
+                     "DRD state unchanged during %s. Skipping write",
+                     context);
+            record.boot_count = persisted_.boot_count;
+            return ESP_OK;
+        }
+#endif
+
+        if (kMaxWritesPerBoot != 0 &&
+            writes_this_boot_ >= kMaxWritesPerBoot &&
+            !retracts_arm)
+        {
+            ESP_LOGW(TAG,
+                     "DRD write budget exhausted. Skipping write during %s. "
+                     "writes=%" PRIu32,
+                     context,
+                     writes_this_boot_);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        ++record.write_count;
+        ++writes_this_boot_;
+        seal_state(record);
+
+        const esp_err_t err = append(record);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "DRD flash append failed during %s. err=%s",
+                     context,
+                     esp_err_to_name(err));
+            return err;
+        }
+
+        persisted_ = record;
+        persisted_valid_ = true;
+        return ESP_OK;
+    }
+
+    esp_err_t FlashRingStorage::append(const StateRecord &record)
+    {
+        if (empty_ || claimed_ >= kRingSlots)
+        {
+            return start_sector(empty_ ? 0 : (sector_ + 1) % sectors_, record);
+        }
+
+        // Claim before writing, so an interrupted record is skipped rather
+        // than written over by the next append.
+        const uint32_t slot = claimed_;
+        const uint32_t bit = slot % 32;
+        const uint32_t word = (bit == 31) ? 0u : (0xFFFFFFFFu << (bit + 1));
+        const uint32_t word_offset = sector_ * kRingSectorSize +
+                                     offsetof(RingHeader, claimed) +
+                                     (slot / 32) * sizeof(uint32_t);
+
+        esp_err_t err =
+            DRD_TIMED(nvs_write_us, nvs_writes,
+                      esp_partition_write(s_ring_partition,
+                                          word_offset,
+                                          &word,
+                                          sizeof(word)));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        claimed_ = slot + 1;
+
+        return DRD_TIMED(nvs_write_us, nvs_writes,
+                         esp_partition_write(s_ring_partition,
+                                             ring_slot_offset(sector_, slot),
+                                             &record,
+                                             sizeof(record)));
+    }
+
+    esp_err_t FlashRingStorage::start_sector(uint32_t sector,
+                                             const StateRecord &record)
+    {
+        const uint32_t base = sector * kRingSectorSize;
+
+        esp_err_t err =
+            DRD_TIMED(nvs_write_us, nvs_writes,
+                      esp_partition_erase_range(s_ring_partition,
+                                                base,
+                                                kRingSectorSize));
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        // Until the magic lands, the previous sector stays the newest.
+        const uint32_t sequence = empty_ ? 0 : sequence_ + 1;
+        const uint32_t claim = 0xFFFFFFFEu;
+
+        struct Write
+        {
+            uint32_t offset;
+            const void *data;
+            size_t len;
+        };
+        const Write writes[] = {
+            {base + static_cast<uint32_t>(offsetof(RingHeader, claimed)),
+             &claim,
+             sizeof(claim)},
+            {ring_slot_offset(sector, 0), &record, sizeof(record)},
+            {base + static_cast<uint32_t>(offsetof(RingHeader, sequence)),
+             &sequence,
+             sizeof(sequence)},
+            {base, &kRingMagic, sizeof(kRingMagic)},
+        };
+
+        for (const Write &w : writes)
+        {
+            err = DRD_TIMED(nvs_write_us, nvs_writes,
+                            esp_partition_write(s_ring_partition,
+                                                w.offset,
+                                                w.data,
+                                                w.len));
+            if (err != ESP_OK)
+            {
+                return err;
+            }
+        }
+
+        ESP_LOGD(TAG,
+                 "DRD flash ring advanced. sector=%" PRIu32
+                 ", sequence=%" PRIu32,
+                 sector,
+                 sequence);
+
+        sector_ = sector;
+        sequence_ = sequence;
+        claimed_ = 1;
+        empty_ = false;
+        return ESP_OK;
+    }
+
+    esp_err_t FlashRingStorage::erase()
+    {
+        const esp_err_t err_open = open();
+        if (err_open != ESP_OK)
+        {
+            ESP_LOGW(TAG, "clear_flag called but DRD flash is not ready");
+            return err_open;
+        }
+
+        persisted_valid_ = false;
+        empty_ = true;
+        claimed_ = 0;
+
+        const esp_err_t err =
+            DRD_TIMED(nvs_write_us, nvs_writes,
+                      esp_partition_erase_range(s_ring_partition,
+                                                0,
+                                                sectors_ * kRingSectorSize));
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG,
+                     "esp_partition_erase_range() in clear_flag failed. "
+                     "err=%s",
+                     esp_err_to_name(err));
+            return err;
+        }
+
+        ESP_LOGI(TAG, "Flash double-reset state cleared");
+        return ESP_OK;
+    }
+#endif
+
+    template <typename Storage, const DrdConfig &Config>
+    BasicDetector<Storage, Config>::BasicDetector(const char *nvs_namespace,
+                                                  ConfigTagOf<Config>)
+        : storage_(nvs_namespace ? nvs_namespace : "drd", Config.nvs_partition)
+    {
+        // Static storage, so this cannot fail and works before the
+        // scheduler starts.
+        lock_ = xSemaphoreCreateRecursiveMutexStatic(&lock_buffer_);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    BasicDetector<Storage, Config>::~BasicDetector()
+    {
+        stop_timer();
+
+        if (timer_ != nullptr)
+        {
+            const esp_err_t err = esp_timer_delete(timer_);
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG,
+                         "esp_timer_delete(DRD) failed. err=%s",
+                         esp_err_to_name(err));
+            }
+
+            timer_ = nullptr;
+        }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        if (channel_timer_ != nullptr)
+        {
+            (void)esp_timer_stop(channel_timer_);
+
+            const esp_err_t err = esp_timer_delete(channel_timer_);
+            if (err != ESP_OK)
+            {
+                ESP_LOGW(TAG,
+                         "esp_timer_delete(DRD channels) failed. err=%s",
+                         esp_err_to_name(err));
+            }
+
+            channel_timer_ = nullptr;
+        }
+#endif
+
+        vSemaphoreDelete(lock_);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::configure()
+    {
+        LockGuard guard(lock_);
+
+        if (configured_)
+        {
+            return ESP_OK;
+        }
+
+        if constexpr (Config.log_level != kLogLevelUnchanged)
+        {
+            esp_log_level_set(TAG,
+                              static_cast<esp_log_level_t>(Config.log_level));
+        }
+
+        DRD_STATS_SCOPE(configure_us);
+
+        // The timer is created once and restarted for every phase, so
+        // arming after boot never allocates.
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        const esp_err_t timer_err = create_timer();
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        if (create_channel_timer() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "DRD channel windows will not close by timer");
+        }
+#endif
+#else
+        (void)create_timer();
+#endif
+
+        const esp_err_t err = storage_.open();
+        configured_ = true;
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        return (err != ESP_OK) ? err : timer_err;
+#else
+        return err;
+#endif
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::use_nvs_handle(uint32_t handle)
+    {
+        if constexpr (Storage::kBackend != Backend::NVS &&
+                      Storage::kBackend != Backend::Hybrid)
+        {
+            (void)handle;
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        else
+        {
+            LockGuard guard(lock_);
+
+            if (configured_)
+            {
+                return ESP_ERR_INVALID_STATE;
+            }
+
+            return storage_.adopt(handle);
+        }
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::check_and_clear()
+    {
+        return check_and_clear_ms(Config.window_ms);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::check_and_clear(uint32_t window_s)
+    {
+        return check_taps_ms(seconds_to_ms(window_s)) >= 2;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::check_and_clear_ms(uint32_t window_ms)
+    {
+        return check_taps_ms(window_ms) >= 2;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::check_taps()
+    {
+        return check_taps_ms(Config.window_ms);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::check_taps(uint32_t window_s)
+    {
+        return check_taps_ms(seconds_to_ms(window_s));
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::check_taps_ms(uint32_t window_ms)
+    {
+        uint8_t taps = 0;
+        if (published(taps))
+        {
+            return taps;
+        }
+
+        EventBatch events;
+
+        {
+            LockGuard guard(lock_);
+
+            // Another task may have finished while this one waited, and a
+            // nested call from this task sees kResultBusy.
+            const uint32_t result = result_.load(std::memory_order_relaxed);
+            if (result != kResultIdle)
+            {
+                return static_cast<uint8_t>(result & kResultTapsMask);
+            }
+
+            result_.store(kResultBusy, std::memory_order_relaxed);
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+            // Writes made while evaluating wait for flush(); the timer
+            // callbacks write through.
+            storage_.defer(true);
+            taps = evaluate(window_ms);
+            storage_.defer(false);
+#else
+            taps = evaluate(window_ms);
+#endif
+            result_.store(kResultDone | taps, std::memory_order_release);
+            events = take_events();
+        }
+
+        deliver(events);
+
+        // A full sequence cannot grow, so it is dispatched right away.
+        if (taps >= kMaxTaps)
+        {
+            dispatch_taps(taps);
+        }
+
+        return taps;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::published(uint8_t &taps) const
+    {
+        const uint32_t result = result_.load(std::memory_order_acquire);
+        if ((result & kResultDone) == 0)
+        {
+            return false;
+        }
+
+        taps = static_cast<uint8_t>(result & kResultTapsMask);
+        return true;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::evaluate(uint32_t window_ms)
+    {
+        DRD_STATS_SCOPE(check_us);
+
+        const esp_reset_reason_t reason = esp_reset_reason();
+        const ResetAction action = reset_action<Config>(reason);
+        if (action == ResetAction::Ignore)
+        {
+            ESP_LOGD(TAG,
+                     "Reset reason %d ignored by policy. Skipping DRD "
+                     "detection",
+                     static_cast<int>(reason));
+            return 0;
+        }
+
+        ESP_LOGI(TAG,
+                 "Reset reason: %d (%s)",
+                 static_cast<int>(reason),
+                 reset_reason_to_string(reason));
+
+        if (action == ResetAction::DelayArm)
+        {
+            ESP_LOGI(TAG,
+                     "Reset reason indicates tooling activity. "
+                     "DRD arming will be delayed");
+        }
+        else if (action == ResetAction::Clear)
+        {
+            ESP_LOGI(TAG, "Reset reason clears DRD state by policy");
+        }
+
+        if (!configured_)
+        {
+            const esp_err_t err = configure();
+            if (err != ESP_OK && kBackend != Backend::RTC)
+            {
+                ESP_LOGW(TAG,
+                         "DRD configure failed with %s storage. "
+                         "Falling back to RTC behavior",
+                         storage_.source());
+                use_fallback_ = true;
+            }
+        }
+
+        uint8_t taps = 0;
+
+        if constexpr (!Storage::kTracksFirmware)
+        {
+            taps = evaluate_untracked(action, window_ms);
+        }
+        else if (use_fallback_)
+        {
+            taps = evaluate_untracked(action, window_ms);
+        }
+        else if (!storage_.ready())
+        {
+            ESP_LOGW(TAG,
+                     "%s backend selected but not ready. "
+                     "Skipping DRD detection",
+                     storage_.source());
+        }
+        else
+        {
+            taps = evaluate_tracked(action, window_ms);
+        }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        schedule_channels();
+#endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        record_history(static_cast<uint8_t>(reason), action, taps);
+#if !defined(CONFIG_DRD_DEFERRED_COMMIT)
+        // Deferred builds leave this write to flush() with the record.
+        if (taps >= 2)
+        {
+            (void)persist_history();
+        }
+#endif
+#endif
+
+        return taps;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t
+    BasicDetector<Storage, Config>::register_tap_handler(uint8_t taps,
+                                                         TapHandler handler,
+                                                         void *arg)
+    {
+        if (taps < 2 || taps > kMaxTaps)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        LockGuard guard(lock_);
+
+        if (result_.load(std::memory_order_relaxed) != kResultIdle)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        tap_handlers_[taps].handler = handler;
+        tap_handlers_[taps].arg = arg;
+        return ESP_OK;
+    }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::configure_channel(
+                uint8_t channel,
+                const ChannelConfig &config)
+    {
+        if (channel == 0 || channel > kExtraChannels ||
+            channel_window_ms(config) == 0 || config.reset_mask == 0 ||
+            config.max_taps < 2)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        LockGuard guard(lock_);
+
+        if (result_.load(std::memory_order_relaxed) != kResultIdle)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        channel_config_[channel - 1] = config;
+        return ESP_OK;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::channel_taps(uint8_t channel)
+    {
+        if (channel == 0 || channel > kExtraChannels)
+        {
+            return 0;
+        }
+
+        // Channel results are written before result_ is published.
+        (void)check_taps();
+        return channel_taps_[channel - 1];
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::step_channels()
+    {
+        const esp_reset_reason_t reason = esp_reset_reason();
+        const int64_t now_us = esp_timer_get_time();
+        bool changed = false;
+
+        for (uint8_t i = 0; i < kExtraChannels; ++i)
+        {
+            const ChannelConfig &config = channel_config_[i];
+            if (config.max_taps == 0)
+            {
+                continue;
+            }
+
+            ChannelState &channel = state_.channels[i];
+            const uint8_t taps = step_channel(channel, config, reason, changed);
+            channel_taps_[i] = taps;
+
+            // An open sequence restarts its window from this boot.
+            channel_deadline_us_[i] =
+                ((channel.flags & kFlagArmed) != 0)
+                    ? now_us + static_cast<int64_t>(
+                                   channel_window_ms(config)) * 1000
+                    : 0;
+
+            if (taps >= 2)
+            {
+                ESP_LOGI(TAG,
+                         "Multi-reset detected on DRD channel %u. taps=%u",
+                         static_cast<unsigned>(i + 1),
+                         static_cast<unsigned>(taps));
+            }
+        }
+
+        return changed;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::schedule_channels()
+    {
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+        // The next boot measures each channel's gap itself.
+        return;
+#else
+        int64_t next_us = 0;
+        for (const int64_t deadline_us : channel_deadline_us_)
+        {
+            if (deadline_us != 0 && (next_us == 0 || deadline_us < next_us))
+            {
+                next_us = deadline_us;
+            }
+        }
+
+        if (channel_timer_ != nullptr)
+        {
+            (void)esp_timer_stop(channel_timer_);
+        }
+
+        if (next_us == 0)
+        {
+            return;
+        }
+
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        // Created in configure(); never allocated this late.
+        if (channel_timer_ == nullptr)
+        {
+            return;
+        }
+#else
+        if (create_channel_timer() != ESP_OK)
+        {
+            return;
+        }
+#endif
+
+        const int64_t now_us = esp_timer_get_time();
+        const uint64_t timeout_us =
+            (next_us > now_us) ? static_cast<uint64_t>(next_us - now_us) : 0;
+
+        const esp_err_t err = esp_timer_start_once(channel_timer_, timeout_us);
+        if (err != ESP_OK)
         {
-            return;
+            ESP_LOGW(TAG,
+                     "esp_timer_start_once(DRD channels) failed. err=%s",
+                     esp_err_to_name(err));
         }
+#endif
+    }
 
-        if (sha == nullptr || len == 0)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::channel_timer_cb(void *arg)
+    {
+        auto *self = static_cast<BasicDetector *>(arg);
+        if (self == nullptr)
         {
-            out[0] = '\0';
             return;
         }
 
-        static const char *hex = "0123456789abcdef";
-        const size_t needed = (len * 2U) + 1U;
+        DRD_TRACE_PART(timer_cb);
+        LockGuard guard(self->lock_);
 
-        if (out_len < needed)
+        // Channels whose windows close together share one write.
+        const int64_t now_us = esp_timer_get_time();
+        bool changed = false;
+        for (uint8_t i = 0; i < kExtraChannels; ++i)
         {
-            out[0] = '\0';
-            return;
+            int64_t &deadline_us = self->channel_deadline_us_[i];
+            if (deadline_us != 0 && deadline_us <= now_us)
+            {
+                self->state_.channels[i] = ChannelState{};
+                deadline_us = 0;
+                changed = true;
+            }
         }
 
-        for (size_t i = 0; i < len; ++i)
+        if (changed)
         {
-            const uint8_t v = sha[i];
-            out[(i * 2U) + 0U] = hex[(v >> 4) & 0x0F];
-            out[(i * 2U) + 1U] = hex[v & 0x0F];
+            if (!self->use_fallback_ && !self->storage_.ready())
+            {
+                ESP_LOGW(TAG,
+                         "DRD channel timer fired but %s backend is not "
+                         "ready",
+                         self->storage_.source());
+            }
+            else
+            {
+                (void)self->store_state("channel disarm");
+                ESP_LOGI(TAG, "DRD channel window elapsed. Channel disarmed");
+            }
         }
 
-        out[len * 2U] = '\0';
+        self->schedule_channels();
     }
+#endif
 
-    bool get_current_app_sha256(std::array<uint8_t, kSha256Len> &out)
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::set_event_callback(
+                EventCallback callback,
+                void *arg)
     {
-        const esp_app_desc_t *app = esp_app_get_description();
-        if (app == nullptr)
+        LockGuard guard(lock_);
+
+        if (result_.load(std::memory_order_relaxed) != kResultIdle)
         {
-            return false;
+            return ESP_ERR_INVALID_STATE;
         }
 
-        std::memcpy(out.data(), app->app_elf_sha256, kSha256Len);
-        return true;
+        event_callback_ = callback;
+        event_arg_ = arg;
+        return ESP_OK;
     }
 
-    esp_err_t safe_nvs_init()
+    template <typename Storage, const DrdConfig &Config>
+    bool BasicDetector<Storage, Config>::observed() const
     {
-        const esp_err_t err = nvs_flash_init();
-
-        if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
-            err == ESP_ERR_NVS_NEW_VERSION_FOUND)
-        {
-            ESP_LOGW(TAG,
-                     "nvs_flash_init reported no free pages or new version. "
-                     "Skipping erase. err=%s",
-                     esp_err_to_name(err));
-        }
-
-        return err;
+#if defined(CONFIG_DRD_POST_EVENTS)
+        return true;
+#else
+        return event_callback_ != nullptr;
+#endif
     }
 
-    const char *reset_reason_to_string(esp_reset_reason_t reason)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::raise(Event event, uint8_t taps)
     {
-        switch (reason)
+        // Called with lock_ held.
+        constexpr size_t kCapacity =
+            sizeof(events_.entries) / sizeof(events_.entries[0]);
+        if (!observed() || events_.count >= kCapacity)
         {
-        case ESP_RST_POWERON:
-            return "Power-on reset";
-        case ESP_RST_EXT:
-            return "External pin reset";
-        case ESP_RST_SW:
-            return "Software reset";
-        case ESP_RST_PANIC:
-            return "Panic reset";
-        case ESP_RST_INT_WDT:
-            return "Interrupt watchdog reset";
-        case ESP_RST_TASK_WDT:
-            return "Task watchdog reset";
-        case ESP_RST_WDT:
-            return "Other watchdog reset";
-        case ESP_RST_DEEPSLEEP:
-            return "Deep-sleep wakeup";
-        case ESP_RST_BROWNOUT:
-            return "Brownout reset";
-        case ESP_RST_SDIO:
-            return "SDIO reset";
-        case ESP_RST_USB:
-            return "USB reset";
-        case ESP_RST_JTAG:
-            return "JTAG reset";
-        default:
-            return "Unknown reset reason";
+            return;
         }
-    }
 
-} // namespace
-
-namespace drd_handler
-{
-    DoubleResetDetector::DoubleResetDetector(Backend backend,
-                                             const char *nvs_namespace)
-        : backend_(backend),
-          nvs_namespace_(nvs_namespace ? nvs_namespace : "drd")
-    {
+        events_.entries[events_.count] = {event, taps};
+        ++events_.count;
     }
 
-    DoubleResetDetector::~DoubleResetDetector()
+    template <typename Storage, const DrdConfig &Config>
+    typename BasicDetector<Storage, Config>::EventBatch
+    BasicDetector<Storage, Config>::take_events()
     {
-        cancel_arm();
-        cancel_disarm();
-
-        if (nvs_ready_)
-        {
-            nvs_handle_t h = static_cast<nvs_handle_t>(nvs_handle_);
-            nvs_close(h);
-        }
-
-        nvs_ready_ = false;
-        nvs_handle_ = 0;
+        // Called with lock_ held.
+        const EventBatch batch = events_;
+        events_.count = 0;
+        return batch;
     }
 
-    esp_err_t DoubleResetDetector::configure()
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::deliver(const EventBatch &batch)
     {
-        if (configured_)
+        // The registration is fixed once evaluation has started.
+        for (uint8_t i = 0; i < batch.count; ++i)
         {
-            return ESP_OK;
-        }
-
-        esp_err_t err = ESP_OK;
+            const auto &entry = batch.entries[i];
 
-        if (backend_ == Backend::NVS)
-        {
-            err = safe_nvs_init();
-            if (err != ESP_OK)
+            if (event_callback_ != nullptr)
             {
-                ESP_LOGW(TAG,
-                         "NVS init failed in configure(). err=%s",
-                         esp_err_to_name(err));
+                event_callback_(entry.event, entry.taps, event_arg_);
             }
 
-            nvs_handle_t h = 0;
-            err = nvs_open(nvs_namespace_, NVS_READWRITE, &h);
+#if defined(CONFIG_DRD_POST_EVENTS)
+            const esp_err_t err =
+                esp_event_post(DRD_EVENT,
+                               static_cast<int32_t>(entry.event),
+                               &entry.taps,
+                               sizeof(entry.taps),
+                               0);
             if (err != ESP_OK)
             {
                 ESP_LOGW(TAG,
-                         "nvs_open('%s') failed. err=%s",
-                         nvs_namespace_,
+                         "esp_event_post(DRD) failed. err=%s",
                          esp_err_to_name(err));
-                nvs_ready_ = false;
-                nvs_handle_ = 0;
-                configured_ = true;
-                return err;
             }
-
-            nvs_ready_ = true;
-            nvs_handle_ = static_cast<uint32_t>(h);
-
-            ESP_LOGI(TAG,
-                     "DRD using NVS backend. namespace='%s'",
-                     nvs_namespace_);
-        }
-        else
-        {
-            ESP_LOGI(TAG, "DRD using RTC backend");
+#endif
         }
-
-        configured_ = true;
-        return err;
     }
 
-    bool DoubleResetDetector::check_and_clear()
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::count_tap()
     {
-        return check_and_clear(CONFIG_DRD_WINDOW_SECONDS);
+        const uint8_t taps = advance_taps(state_);
+        if (taps < kMaxTaps)
+        {
+            pending_taps_ = taps;
+        }
+
+        return taps;
     }
 
-    bool DoubleResetDetector::check_and_clear(uint32_t window_s)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::dispatch_taps(uint8_t taps)
     {
-        if (evaluated_)
+        if (taps > kMaxTaps)
         {
-            return cached_result_;
+            return;
         }
 
-        evaluated_ = true;
-        cached_result_ = false;
-
-        const esp_reset_reason_t reason = esp_reset_reason();
-        const bool tooling_reset = is_tooling_reset(reason);
+        const TapSlot &slot = tap_handlers_[taps];
+        if (slot.handler != nullptr)
+        {
+            slot.handler(taps, slot.arg);
+        }
+    }
 
-        ESP_LOGI(TAG,
-                 "Reset reason: %d (%s)",
-                 static_cast<int>(reason),
-                 reset_reason_to_string(reason));
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t
+    BasicDetector<Storage, Config>::evaluate_untracked(ResetAction action,
+                                                       uint32_t window_ms)
+    {
+        (void)load_state();
 
-        if (tooling_reset)
+        UntrackedStep step;
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+        if (s_early.valid)
         {
-            ESP_LOGI(TAG,
-                     "Reset reason indicates tooling activity. "
-                     "DRD arming will be delayed");
+            // The record was advanced and stored before app_main; only the
+            // disarm timer, which needs the scheduler, is left to start.
+            step = s_early.step;
         }
-
-        if (!configured_)
+        else
+#endif
         {
-            const esp_err_t err = configure();
-            if (err != ESP_OK && backend_ == Backend::NVS)
-            {
-                ESP_LOGW(TAG,
-                         "DRD configure failed with NVS backend. "
-                         "Falling back to RTC behavior");
-                backend_ = Backend::RTC;
-            }
+            step = step_untracked(state_, action, window_ms);
         }
 
-        bool double_reset = false;
-
-        if (backend_ == Backend::RTC)
+        if (step.taps >= 2 && step.taps < kMaxTaps)
         {
-            if (tooling_reset)
-            {
-                s_rtc_magic = 0;
-                cached_result_ = false;
-                return false;
-            }
-
-            if (s_rtc_magic == kDrdMagic)
-            {
-                ESP_LOGI(TAG, "Double reset detected using RTC backend");
-                double_reset = true;
-                s_rtc_magic = 0;
-            }
-            else
-            {
-                ESP_LOGI(TAG,
-                         "Arming RTC double-reset window. window_s=%" PRIu32,
-                         window_s);
-                s_rtc_magic = kDrdMagic;
-                schedule_disarm(window_s);
-            }
-
-            cached_result_ = double_reset;
-            return double_reset;
+            pending_taps_ = step.taps;
         }
 
-        if (!nvs_ready_)
+        if (step.taps >= 2)
         {
-            ESP_LOGW(TAG,
-                     "NVS backend selected but not ready. "
-                     "Skipping DRD detection");
-            cached_result_ = false;
-            return false;
+            raise(Event::Detected, step.taps);
         }
 
-        nvs_handle_t h = static_cast<nvs_handle_t>(nvs_handle_);
-
-        std::array<uint8_t, kSha256Len> current_sha = {};
-        if (!get_current_app_sha256(current_sha))
+        if (step.closed_taps != 0)
         {
-            ESP_LOGW(TAG,
-                     "Failed to read app ELF SHA-256. Treating firmware as "
-                     "dirty for DRD");
-            firmware_id_dirty_ = true;
+            raise(Event::Disarmed, step.closed_taps);
         }
 
-        std::array<uint8_t, kSha256Len> stored_sha = {};
-        size_t stored_len = kSha256Len;
-        bool stored_sha_valid = false;
-
-        const esp_err_t err_sha =
-            nvs_get_blob(h, kKeyAppSha256, stored_sha.data(), &stored_len);
-
-        if (err_sha == ESP_OK && stored_len == kSha256Len)
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        if (step_channels() && step.context == nullptr)
         {
-            stored_sha_valid = true;
+            step.context = "channel update";
         }
-        else if (err_sha == ESP_ERR_NVS_NOT_FOUND)
+#endif
+
+        if (step.context != nullptr && store_state(step.context) != ESP_OK)
         {
-            stored_sha_valid = false;
+            return step.taps;
         }
-        else
+
+        if (step.open_window)
         {
-            ESP_LOGW(TAG,
-                     "nvs_get_blob(app_sha256) failed. err=%s",
-                     esp_err_to_name(err_sha));
-            stored_sha_valid = false;
+            schedule_disarm(window_ms);
         }
 
-        uint32_t legacy_hash = 0;
-        const esp_err_t err_legacy = nvs_get_u32(h, kKeyAppHash, &legacy_hash);
-        const bool legacy_present = (err_legacy == ESP_OK);
+        return step.taps;
+    }
 
-        uint8_t first_boot_raw = 0;
-        bool first_boot_seen = false;
-        const esp_err_t err_fb_read =
-            nvs_get_u8(h, kKeyFirstBoot, &first_boot_raw);
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::evaluate_tracked(ResetAction action,
+                                                             uint32_t window_ms)
+    {
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+        arm_delay_ms_ = tune_arm_delay(action, Config.arm_delay_ms);
+#endif
 
-        if (err_fb_read == ESP_OK)
-        {
-            first_boot_seen = (first_boot_raw != 0);
-        }
-        else if (err_fb_read != ESP_ERR_NVS_NOT_FOUND)
+        std::array<uint8_t, kSha256Len> current_sha = {};
+        if (!get_current_app_sha256(current_sha))
         {
             ESP_LOGW(TAG,
-                     "nvs_get_u8(first_boot) failed. err=%s",
-                     esp_err_to_name(err_fb_read));
+                     "Failed to read app ELF SHA-256. Treating firmware as "
+                     "dirty for DRD");
+            firmware_id_dirty_ = true;
         }
 
+        // One record read covers identity, dirty and arm state.
+        (void)load_state();
+        const bool legacy_present = storage_.pending_write();
+        bool write_needed = legacy_present;
+
+        const bool stored_sha_valid = (state_.magic == kStateMagic);
         bool firmware_changed = false;
 
         if (!stored_sha_valid)
@@ -382,7 +2874,7 @@ namespace drd_handler
             if (legacy_present)
             {
                 ESP_LOGI(TAG,
-                         "No stored app SHA-256 but legacy app_hash exists. "
+                         "Legacy DRD keys exist without a stored app SHA-256. "
                          "Migrating DRD identity");
             }
             else
@@ -392,9 +2884,10 @@ namespace drd_handler
                          "for this image");
             }
         }
-        else if (std::memcmp(stored_sha.data(),
+        else if (firmware_id_dirty_ ||
+                 std::memcmp(state_.app_sha256,
                              current_sha.data(),
-                             kSha256Len) != 0)
+                             kIdentityLen) != 0)
         {
             firmware_changed = true;
             ESP_LOGI(TAG, "Firmware identity changed for DRD");
@@ -404,520 +2897,820 @@ namespace drd_handler
             ESP_LOGI(TAG, "Firmware identity unchanged for DRD");
         }
 
-        if (stored_sha_valid)
-        {
-            char stored_hex[(kSha256Len * 2U) + 1U] = {};
-            sha256_to_hex(stored_sha.data(),
-                          kSha256Len,
-                          stored_hex,
-                          sizeof(stored_hex));
-            ESP_LOGI(TAG, "DRD stored app SHA-256: %s", stored_hex);
-        }
-        else
+        // Hashes are only printed when the identity changed; an unchanged
+        // boot skips the hex formatting entirely.
+        if (firmware_changed)
         {
-            ESP_LOGI(TAG, "DRD stored app SHA-256: <none>");
-        }
+            if (stored_sha_valid)
+            {
+                log_sha256("stored", state_.app_sha256, kIdentityLen);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "DRD stored app SHA-256: <none>");
+            }
 
-        {
-            char current_hex[(kSha256Len * 2U) + 1U] = {};
-            sha256_to_hex(current_sha.data(),
-                          kSha256Len,
-                          current_hex,
-                          sizeof(current_hex));
-            ESP_LOGI(TAG, "DRD current app SHA-256: %s", current_hex);
+            log_sha256("current", current_sha.data(), kSha256Len);
+
+            const uint32_t boot_count = state_.boot_count;
+            const uint32_t write_count = state_.write_count;
+
+            state_ = StateRecord{};
+            state_.boot_count = boot_count;
+            state_.write_count = write_count;
+            std::memcpy(state_.app_sha256, current_sha.data(), kIdentityLen);
+            state_.flags = kFlagDirty | kFlagFirstBoot;
+            write_needed = true;
+
+            ESP_LOGI(TAG,
+                     "DRD state reset due to firmware identity change. "
+                     "Firmware marked dirty for DRD");
+            firmware_id_dirty_ = true;
         }
 
-        if (firmware_changed)
+        const bool firmware_dirty = (state_.flags & kFlagDirty) != 0;
+        const bool first_boot_seen = (state_.flags & kFlagFirstBoot) != 0;
+        const bool armed = (state_.flags & kFlagArmed) != 0;
+
+        ESP_LOGI(TAG,
+                 "DRD status. firmware_dirty=%s, first_boot_seen=%s",
+                 firmware_dirty ? "true" : "false",
+                 first_boot_seen ? "true" : "false");
+
+        const char *write_context = "identity update";
+        uint8_t taps = 1;
+        bool arm_after_delay = false;
+        bool disarm_after_window = false;
+
+        if (action == ResetAction::Count && !firmware_dirty && armed &&
+            window_open(state_, window_ms))
         {
-            esp_err_t err = nvs_erase_key(h, kKeyMagic);
-            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            stop_timer();
+
+            taps = count_tap();
+            ESP_LOGI(TAG,
+                     "Multi-reset detected using %s state. taps=%u",
+                     storage_.source(),
+                     static_cast<unsigned>(taps));
+
+            write_needed = true;
+            write_context = "detection";
+            // An unfinished sequence keeps the window open for the next tap.
+            disarm_after_window = (taps < kMaxTaps);
+
+            raise(Event::Detected, taps);
+            if (!disarm_after_window)
             {
-                ESP_LOGW(TAG,
-                         "nvs_erase_key(magic) after firmware change failed. "
-                         "err=%s",
-                         esp_err_to_name(err));
+                raise(Event::Disarmed, taps);
             }
+        }
+        else if (firmware_dirty)
+        {
+            ESP_LOGI(TAG,
+                     "Firmware dirty for DRD. Arming after delay. "
+                     "delay_ms=%" PRIu32 ", window_ms=%" PRIu32,
+                     arm_delay_ms_,
+                     window_ms);
+            arm_after_delay = true;
+            raise(Event::FirmwareDirty, 0);
+        }
+        else if (action != ResetAction::Count)
+        {
+            arm_after_delay = (action == ResetAction::DelayArm);
 
-            err = nvs_set_blob(h,
-                               kKeyAppSha256,
-                               current_sha.data(),
-                               kSha256Len);
-            if (err != ESP_OK)
+            if (arm_after_delay)
             {
-                ESP_LOGW(TAG,
-                         "nvs_set_blob(app_sha256) failed. err=%s",
-                         esp_err_to_name(err));
+                ESP_LOGI(TAG,
+                         "Tooling reset detected. Clearing DRD flag and "
+                         "arming after delay. delay_ms=%" PRIu32
+                         ", window_ms=%" PRIu32,
+                         arm_delay_ms_,
+                         window_ms);
             }
-
-            if (legacy_present)
+            else
             {
-                err = nvs_erase_key(h, kKeyAppHash);
-                if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
-                {
-                    ESP_LOGW(TAG,
-                             "nvs_erase_key(app_hash) during migration failed. "
-                             "err=%s",
-                             esp_err_to_name(err));
-                }
+                ESP_LOGI(TAG, "Clearing DRD flag. No window this boot");
             }
 
-            const esp_err_t err_dirty = nvs_set_u8(h, kKeyDirty, 1);
-            if (err_dirty != ESP_OK)
+            if (armed)
             {
-                ESP_LOGW(TAG,
-                         "nvs_set_u8(fw_dirty=1) failed. err=%s",
-                         esp_err_to_name(err_dirty));
+                raise(Event::Disarmed, (state_.taps != 0) ? state_.taps : 1);
+                state_.flags &= static_cast<uint8_t>(~kFlagArmed);
+                state_.taps = 0;
+                write_needed = true;
+                write_context = "reset policy clear";
             }
+        }
+        else
+        {
+            ESP_LOGI(TAG,
+                     "Firmware clean. Arming DRD window. window_ms=%" PRIu32,
+                     window_ms);
+
+            state_.flags |= kFlagArmed;
+            state_.taps = 1;
+            stamp_arm(state_);
+            write_needed = true;
+            write_context = "arming";
+            disarm_after_window = true;
+        }
 
-            const esp_err_t err_fb = nvs_set_u8(h, kKeyFirstBoot, 1);
-            if (err_fb != ESP_OK)
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        // Channels ride on the same record write.
+        if (step_channels())
+        {
+            if (!write_needed)
             {
-                ESP_LOGW(TAG,
-                         "nvs_set_u8(first_boot=1) failed. err=%s",
-                         esp_err_to_name(err_fb));
+                write_context = "channel update";
             }
-            else
+            write_needed = true;
+        }
+#endif
+
+        // At most one record write per boot, whichever path was taken.
+        if (write_needed)
+        {
+            ++state_.boot_count;
+
+            if (store_state(write_context) != ESP_OK)
             {
-                first_boot_seen = true;
+                disarm_after_window = false;
             }
+        }
 
-            err = nvs_commit(h);
-            if (err != ESP_OK)
+        if (arm_after_delay)
+        {
+            schedule_arm(window_ms);
+        }
+
+        if (disarm_after_window)
+        {
+            schedule_disarm(window_ms);
+        }
+
+        return taps;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::load_state()
+    {
+        return use_fallback_ ? fallback_.load(state_) : storage_.load(state_);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::store_state(const char *context)
+    {
+        return use_fallback_ ? fallback_.store(state_, context)
+                             : storage_.store(state_, context);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::check_and_clear_async(
+                uint32_t window_s,
+                ResultCallback callback,
+                void *arg)
+    {
+        return check_and_clear_async_ms(seconds_to_ms(window_s),
+                                        callback,
+                                        arg);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::check_and_clear_async_ms(
+                uint32_t window_ms,
+                ResultCallback callback,
+                void *arg)
+    {
+        uint8_t taps = 0;
+        if (published(taps))
+        {
+            if (callback != nullptr)
             {
-                ESP_LOGW(TAG,
-                         "nvs_commit() after identity update failed. err=%s",
-                         esp_err_to_name(err));
+                callback(taps >= 2, arg);
             }
+            return ESP_OK;
+        }
 
-            ESP_LOGI(TAG,
-                     "DRD state reset due to firmware identity change. "
-                     "Firmware marked dirty for DRD");
-            firmware_id_dirty_ = true;
+        LockGuard guard(lock_);
+
+        if (async_task_ != nullptr)
+        {
+            return ESP_ERR_INVALID_STATE;
         }
 
-        uint8_t fw_dirty_val = 0;
-        bool firmware_dirty = false;
-        const esp_err_t err_fd = nvs_get_u8(h, kKeyDirty, &fw_dirty_val);
+        async_callback_ = callback;
+        async_arg_ = arg;
+        async_group_ = nullptr;
+        async_done_bits_ = 0;
+        async_detected_bits_ = 0;
 
-        if (err_fd == ESP_OK)
+        return start_async(window_ms);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::check_and_clear_async(
+                uint32_t window_s,
+                EventGroupHandle_t group,
+                EventBits_t done_bits,
+                EventBits_t detected_bits)
+    {
+        return check_and_clear_async_ms(seconds_to_ms(window_s),
+                                        group,
+                                        done_bits,
+                                        detected_bits);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::check_and_clear_async_ms(
+                uint32_t window_ms,
+                EventGroupHandle_t group,
+                EventBits_t done_bits,
+                EventBits_t detected_bits)
+    {
+        if (group == nullptr || done_bits == 0)
         {
-            firmware_dirty = (fw_dirty_val != 0);
+            return ESP_ERR_INVALID_ARG;
         }
-        else if (err_fd == ESP_ERR_NVS_NOT_FOUND)
+
+        uint8_t taps = 0;
+        if (published(taps))
         {
-            firmware_dirty = firmware_changed || firmware_id_dirty_;
+            (void)xEventGroupSetBits(group,
+                                     done_bits |
+                                         (taps >= 2 ? detected_bits : 0));
+            return ESP_OK;
         }
-        else
+
+        LockGuard guard(lock_);
+
+        if (async_task_ != nullptr)
         {
-            firmware_dirty = true;
-            ESP_LOGW(TAG,
-                     "nvs_get_u8(fw_dirty) failed. Assuming dirty. err=%s",
-                     esp_err_to_name(err_fd));
+            return ESP_ERR_INVALID_STATE;
         }
 
-        ESP_LOGI(TAG,
-                 "DRD status. firmware_dirty=%s, first_boot_seen=%s",
-                 firmware_dirty ? "true" : "false",
-                 first_boot_seen ? "true" : "false");
+        async_callback_ = nullptr;
+        async_arg_ = nullptr;
+        async_group_ = group;
+        async_done_bits_ = done_bits;
+        async_detected_bits_ = detected_bits;
 
-        uint32_t stored_magic = 0;
-        const esp_err_t err_magic = nvs_get_u32(h, kKeyMagic, &stored_magic);
+        return start_async(window_ms);
+    }
 
-        if (err_magic != ESP_OK && err_magic != ESP_ERR_NVS_NOT_FOUND)
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::start_async(uint32_t window_ms)
+    {
+        // Called with lock_ held. If evaluation completes before the task
+        // runs, the task simply reports the published result.
+        async_window_ms_ = window_ms;
+
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        // Only one evaluation runs per boot, so the buffers are never
+        // reused while the task is still being deleted.
+        async_task_ = xTaskCreateStatic(&BasicDetector::async_task,
+                                        "drd_eval",
+                                        CONFIG_DRD_ASYNC_TASK_STACK_SIZE,
+                                        this,
+                                        CONFIG_DRD_ASYNC_TASK_PRIORITY,
+                                        async_stack_,
+                                        &async_task_buffer_);
+        if (async_task_ == nullptr)
         {
-            ESP_LOGW(TAG,
-                     "nvs_get_u32(magic) failed. err=%s",
-                     esp_err_to_name(err_magic));
+            ESP_LOGW(TAG, "xTaskCreateStatic(DRD evaluation) failed");
+            return ESP_ERR_NO_MEM;
+        }
+#else
+        const BaseType_t ok = xTaskCreate(&BasicDetector::async_task,
+                                          "drd_eval",
+                                          CONFIG_DRD_ASYNC_TASK_STACK_SIZE,
+                                          this,
+                                          CONFIG_DRD_ASYNC_TASK_PRIORITY,
+                                          &async_task_);
+        if (ok != pdPASS)
+        {
+            ESP_LOGW(TAG, "xTaskCreate(DRD evaluation) failed");
+            async_task_ = nullptr;
+            return ESP_ERR_NO_MEM;
         }
+#endif
+
+        return ESP_OK;
+    }
 
-        if (!tooling_reset && !firmware_dirty && stored_magic == kDrdMagic)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::finish_async(bool double_reset)
+    {
+        if (async_callback_ != nullptr)
         {
-            ESP_LOGI(TAG, "Double reset detected using NVS backend");
-            double_reset = true;
+            async_callback_(double_reset, async_arg_);
+        }
 
-            cancel_disarm();
+        if (async_group_ != nullptr)
+        {
+            const EventBits_t bits =
+                async_done_bits_ | (double_reset ? async_detected_bits_ : 0);
+            (void)xEventGroupSetBits(async_group_, bits);
+        }
+    }
 
-            esp_err_t err = nvs_erase_key(h, kKeyMagic);
-            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
-            {
-                ESP_LOGW(TAG,
-                         "nvs_erase_key(magic) failed. err=%s",
-                         esp_err_to_name(err));
-            }
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::async_task(void *arg)
+    {
+        auto *self = static_cast<BasicDetector *>(arg);
 
-            err = nvs_commit(h);
-            if (err != ESP_OK)
-            {
-                ESP_LOGW(TAG,
-                         "nvs_commit() after erase failed. err=%s",
-                         esp_err_to_name(err));
-            }
+        const bool double_reset =
+            self->check_and_clear_ms(self->async_window_ms_);
+        // The request fields are stable while async_task_ is set.
+        self->finish_async(double_reset);
 
-            cached_result_ = double_reset;
-            return double_reset;
+        {
+            LockGuard guard(self->lock_);
+            self->async_task_ = nullptr;
         }
+        vTaskDelete(nullptr);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::flush()
+    {
+        LockGuard guard(lock_);
+        esp_err_t err = ESP_OK;
 
-        if (firmware_dirty)
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        if (!use_fallback_)
         {
-            ESP_LOGI(TAG,
-                     "Firmware dirty for DRD. Arming after delay. delay_s=%u, "
-                     "window_s=%" PRIu32,
-                     CONFIG_DRD_ARM_DELAY_SECONDS,
-                     window_s);
-            schedule_arm(window_s);
+            err = storage_.flush();
         }
-        else if (tooling_reset)
-        {
-            ESP_LOGI(TAG,
-                     "Tooling reset detected. Clearing DRD flag and arming "
-                     "after delay. delay_s=%u, window_s=%" PRIu32,
-                     CONFIG_DRD_ARM_DELAY_SECONDS,
-                     window_s);
+#endif
 
-            esp_err_t err = nvs_erase_key(h, kKeyMagic);
-            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
-            {
-                ESP_LOGW(TAG,
-                         "nvs_erase_key(magic) during tooling reset failed. "
-                         "err=%s",
-                         esp_err_to_name(err));
-            }
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        const esp_err_t history_err = persist_history();
+        if (err == ESP_OK)
+        {
+            err = history_err;
+        }
+#endif
 
-            err = nvs_commit(h);
-            if (err != ESP_OK)
-            {
-                ESP_LOGW(TAG,
-                         "nvs_commit() after tooling reset clear failed. "
-                         "err=%s",
-                         esp_err_to_name(err));
-            }
+        return err;
+    }
 
-            schedule_arm(window_s);
-        }
-        else
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::record_history(uint8_t reason,
+                                                        ResetAction action,
+                                                        uint8_t taps)
+    {
+        if (!history_valid(s_history))
         {
-            ESP_LOGI(TAG,
-                     "Firmware clean. Arming DRD window. window_s=%" PRIu32,
-                     window_s);
+            s_history = HistoryRing{};
+            s_history.magic = kHistoryMagic;
+            s_history.last_rtc_ms = kHistoryRtcUnknown;
 
-            esp_err_t err = nvs_set_u32(h, kKeyMagic, kDrdMagic);
-            if (err != ESP_OK)
+            // RTC memory was lost; resume from the last NVS copy.
+            if constexpr (Storage::kBackend == Backend::NVS ||
+                          Storage::kBackend == Backend::Hybrid)
             {
-                ESP_LOGW(TAG,
-                         "nvs_set_u32(magic) failed. err=%s",
-                         esp_err_to_name(err));
-            }
-            else
-            {
-                err = nvs_commit(h);
-                if (err != ESP_OK)
-                {
-                    ESP_LOGW(TAG,
-                             "nvs_commit() after arming failed. err=%s",
-                             esp_err_to_name(err));
-                }
-                else
+                HistoryRing stored{};
+                if (!use_fallback_ &&
+                    storage_.load_history(&stored, sizeof(stored)) == ESP_OK &&
+                    history_valid(stored))
                 {
-                    schedule_disarm(window_s);
+                    s_history = stored;
+                    s_history.unsaved = 0;
+                    s_history.last_rtc_ms = kHistoryRtcUnknown;
                 }
             }
         }
 
-        cached_result_ = double_reset;
-        return double_reset;
+        HistoryEntry entry{};
+        entry.reset_reason = reason;
+        entry.action = action;
+        entry.taps = taps;
+        entry.firmware_dirty = Storage::kTracksFirmware && !use_fallback_ &&
+                               (state_.flags & kFlagDirty) != 0;
+        entry.gap_s = history_gap_s(s_history, reason);
+
+        s_history.entries[s_history.head] = pack_history(entry);
+        s_history.head =
+            static_cast<uint8_t>((s_history.head + 1) % kHistoryLength);
+        if (s_history.count < kHistoryLength)
+        {
+            ++s_history.count;
+        }
+        s_history.unsaved = 1;
+        s_history.last_rtc_ms =
+            static_cast<uint32_t>(esp_rtc_get_time_us() / 1000ULL);
+        seal_history(s_history);
     }
 
-    void DoubleResetDetector::clear_flag()
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::persist_history()
     {
-        if (backend_ == Backend::RTC)
+        // Called with lock_ held.
+        if constexpr (Storage::kBackend != Backend::NVS &&
+                      Storage::kBackend != Backend::Hybrid)
         {
-            s_rtc_magic = 0;
-            ESP_LOGI(TAG, "RTC double-reset flag cleared");
-            return;
+            return ESP_OK;
         }
-
-        if (!nvs_ready_)
+        else
         {
-            ESP_LOGW(TAG, "clear_flag called but NVS is not ready");
-            return;
-        }
-
-        nvs_handle_t h = static_cast<nvs_handle_t>(nvs_handle_);
+            if (use_fallback_ || !history_valid(s_history) ||
+                s_history.unsaved == 0)
+            {
+                return ESP_OK;
+            }
 
-        const char *keys[] = {
-            kKeyMagic,
-            kKeyBoot,
-            kKeyDirty,
-            kKeyFirstBoot,
-            kKeyAppSha256,
-            kKeyAppHash,
-        };
+            s_history.unsaved = 0;
+            seal_history(s_history);
 
-        for (const char *key : keys)
-        {
-            const esp_err_t err = nvs_erase_key(h, key);
-            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            const esp_err_t err =
+                storage_.store_history(&s_history, sizeof(s_history));
+            if (err != ESP_OK)
             {
-                ESP_LOGW(TAG,
-                         "nvs_erase_key('%s') failed. err=%s",
-                         key,
-                         esp_err_to_name(err));
+                s_history.unsaved = 1;
+                seal_history(s_history);
             }
-        }
 
-        const esp_err_t err_commit = nvs_commit(h);
-        if (err_commit != ESP_OK)
-        {
-            ESP_LOGW(TAG,
-                     "nvs_commit() in clear_flag failed. err=%s",
-                     esp_err_to_name(err_commit));
+            return err;
         }
-
-        ESP_LOGI(TAG, "NVS double-reset flag cleared");
     }
 
-    void DoubleResetDetector::cancel_arm()
+    template <typename Storage, const DrdConfig &Config>
+    size_t BasicDetector<Storage, Config>::history(HistoryEntry *out,
+                                                   size_t max) const
     {
-        if (arm_timer_ == nullptr)
-        {
-            return;
-        }
+        LockGuard guard(lock_);
 
-        esp_err_t err = esp_timer_stop(arm_timer_);
-        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        if (out == nullptr || !history_valid(s_history))
         {
-            ESP_LOGW(TAG,
-                     "esp_timer_stop(DRD arm) failed. err=%s",
-                     esp_err_to_name(err));
+            return 0;
         }
 
-        err = esp_timer_delete(arm_timer_);
-        if (err != ESP_OK)
+        const size_t count = (max < s_history.count) ? max : s_history.count;
+        for (size_t i = 0; i < count; ++i)
         {
-            ESP_LOGW(TAG,
-                     "esp_timer_delete(DRD arm) failed. err=%s",
-                     esp_err_to_name(err));
+            const size_t slot =
+                (s_history.head + kHistoryLength - 1 - i) % kHistoryLength;
+            out[i] = unpack_history(s_history.entries[slot]);
         }
 
-        arm_timer_ = nullptr;
-        arm_window_s_ = 0;
+        return count;
     }
+#endif
 
-    void DoubleResetDetector::schedule_arm(uint32_t window_s)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::clear_flag()
     {
-        cancel_arm();
-
-        arm_window_s_ = window_s;
+        LockGuard guard(lock_);
 
-        const uint32_t delay_s = CONFIG_DRD_ARM_DELAY_SECONDS;
+        // Keep the wear counter running across an explicit clear.
+        const uint32_t write_count = state_.write_count;
+        state_ = StateRecord{};
+        state_.write_count = write_count;
 
-        if (delay_s == 0)
+        if (use_fallback_)
         {
-            arm_timer_cb(this);
+            (void)fallback_.erase();
             return;
         }
 
-        const int64_t delay_us =
-            static_cast<int64_t>(delay_s) * 1000000LL;
+        (void)storage_.erase();
+    }
+
+#if defined(CONFIG_DRD_ENABLE_STATS)
+    template <typename Storage, const DrdConfig &Config>
+    const Stats &BasicDetector<Storage, Config>::stats() const
+    {
+        return s_stats;
+    }
+#endif
+
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::create_timer()
+    {
+        if (timer_ != nullptr)
+        {
+            return ESP_OK;
+        }
 
         esp_timer_create_args_t args = {};
-        args.callback = &DoubleResetDetector::arm_timer_cb;
+        args.callback = &BasicDetector::timer_cb;
         args.arg = this;
         args.dispatch_method = ESP_TIMER_TASK;
-        args.name = "drd_arm";
+        args.name = "drd";
 
-        esp_err_t err = esp_timer_create(&args, &arm_timer_);
+        const esp_err_t err =
+            DRD_TIMED(timer_create_us, timer_creates,
+                      esp_timer_create(&args, &timer_));
         if (err != ESP_OK)
         {
             ESP_LOGW(TAG,
-                     "esp_timer_create(DRD arm delay) failed. err=%s",
+                     "esp_timer_create(DRD) failed. err=%s",
                      esp_err_to_name(err));
-            arm_timer_ = nullptr;
-            return;
+            timer_ = nullptr;
         }
 
-        err = esp_timer_start_once(arm_timer_, delay_us);
-        if (err != ESP_OK)
-        {
-            ESP_LOGW(TAG,
-                     "esp_timer_start_once(DRD arm delay) failed. err=%s",
-                     esp_err_to_name(err));
-            esp_timer_delete(arm_timer_);
-            arm_timer_ = nullptr;
-        }
+        return err;
     }
 
-    void DoubleResetDetector::arm_timer_cb(void *arg)
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    template <typename Storage, const DrdConfig &Config>
+    esp_err_t BasicDetector<Storage, Config>::create_channel_timer()
     {
-        auto *self = static_cast<DoubleResetDetector *>(arg);
-        if (self == nullptr)
+        if (channel_timer_ != nullptr)
         {
-            return;
+            return ESP_OK;
         }
 
-        self->arm_timer_ = nullptr;
+        esp_timer_create_args_t args = {};
+        args.callback = &BasicDetector::channel_timer_cb;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "drd_ch";
 
-        if (self->backend_ != Backend::NVS || !self->nvs_ready_)
+        const esp_err_t err =
+            DRD_TIMED(timer_create_us, timer_creates,
+                      esp_timer_create(&args, &channel_timer_));
+        if (err != ESP_OK)
         {
             ESP_LOGW(TAG,
-                     "DRD arm timer fired but NVS backend is not ready");
-            return;
+                     "esp_timer_create(DRD channels) failed. err=%s",
+                     esp_err_to_name(err));
+            channel_timer_ = nullptr;
         }
 
-        nvs_handle_t h = static_cast<nvs_handle_t>(self->nvs_handle_);
+        return err;
+    }
+#endif
 
-        ESP_LOGI(TAG,
-                 "DRD arm delay elapsed. Marking firmware clean and arming. "
-                 "window_s=%" PRIu32,
-                 self->arm_window_s_);
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::start_timer(TimerPhase phase,
+                                                     uint64_t timeout_us)
+    {
+        stop_timer();
 
-        esp_err_t err = nvs_set_u8(h, kKeyDirty, 0);
-        if (err != ESP_OK)
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        // Created in configure(); never allocated this late.
+        if (timer_ == nullptr)
         {
             ESP_LOGW(TAG,
-                     "nvs_set_u8(fw_dirty=0) failed in arm callback. err=%s",
-                     esp_err_to_name(err));
+                     "DRD %s timer not created in configure()",
+                     (phase == TimerPhase::ArmDelay) ? "arm delay" : "disarm");
             return;
         }
-
-        err = nvs_set_u32(h, kKeyMagic, kDrdMagic);
-        if (err != ESP_OK)
+#else
+        // Normally created in configure(); retried here in case that failed.
+        if (create_timer() != ESP_OK)
         {
-            ESP_LOGW(TAG,
-                     "nvs_set_u32(magic) failed in arm callback. err=%s",
-                     esp_err_to_name(err));
             return;
         }
+#endif
 
-        err = nvs_commit(h);
+        const esp_err_t err = esp_timer_start_once(timer_, timeout_us);
         if (err != ESP_OK)
         {
             ESP_LOGW(TAG,
-                     "nvs_commit() failed in arm callback. err=%s",
+                     "esp_timer_start_once(DRD %s) failed. err=%s",
+                     (phase == TimerPhase::ArmDelay) ? "arm delay" : "disarm",
                      esp_err_to_name(err));
             return;
         }
 
-        self->schedule_disarm(self->arm_window_s_);
+        timer_phase_ = phase;
     }
 
-    void DoubleResetDetector::cancel_disarm()
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::stop_timer()
     {
-        if (disarm_timer_ == nullptr)
+        if (timer_ == nullptr || timer_phase_ == TimerPhase::Idle)
         {
             return;
         }
 
-        esp_err_t err = esp_timer_stop(disarm_timer_);
+        const esp_err_t err = esp_timer_stop(timer_);
         if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
         {
             ESP_LOGW(TAG,
-                     "esp_timer_stop(DRD disarm) failed. err=%s",
+                     "esp_timer_stop(DRD) failed. err=%s",
                      esp_err_to_name(err));
         }
 
-        err = esp_timer_delete(disarm_timer_);
-        if (err != ESP_OK)
+        timer_phase_ = TimerPhase::Idle;
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::timer_cb(void *arg)
+    {
+        auto *self = static_cast<BasicDetector *>(arg);
+        if (self == nullptr)
         {
-            ESP_LOGW(TAG,
-                     "esp_timer_delete(DRD disarm) failed. err=%s",
-                     esp_err_to_name(err));
+            return;
+        }
+
+        DRD_TRACE_PART(timer_cb);
+
+        uint8_t taps = 0;
+        EventBatch events;
+
+        {
+            // A stop issued while this callback waited for the lock leaves
+            // the phase Idle, so the stale expiry does nothing.
+            LockGuard guard(self->lock_);
+
+            const TimerPhase phase = self->timer_phase_;
+            self->timer_phase_ = TimerPhase::Idle;
+
+            if (phase == TimerPhase::ArmDelay)
+            {
+                self->on_arm_delay();
+            }
+            else if (phase == TimerPhase::DisarmWindow)
+            {
+                taps = self->on_disarm_window();
+            }
+
+            events = self->take_events();
         }
 
-        disarm_timer_ = nullptr;
+        self->deliver(events);
+
+        if (taps >= 2)
+        {
+            self->dispatch_taps(taps);
+        }
     }
 
-    void DoubleResetDetector::schedule_disarm(uint32_t window_s)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::schedule_arm(uint32_t window_ms)
     {
-        cancel_disarm();
+        arm_window_ms_ = window_ms;
 
-        esp_timer_create_args_t args = {};
-        args.callback = &DoubleResetDetector::disarm_timer_cb;
-        args.arg = this;
-        args.dispatch_method = ESP_TIMER_TASK;
-        args.name = "drd_disarm";
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+        note_arm_delay();
+#endif
 
-        esp_err_t err = esp_timer_create(&args, &disarm_timer_);
-        if (err != ESP_OK)
+        if (arm_delay_ms_ == 0)
         {
-            ESP_LOGW(TAG,
-                     "esp_timer_create(DRD disarm) failed. err=%s",
-                     esp_err_to_name(err));
-            disarm_timer_ = nullptr;
+            stop_timer();
+            on_arm_delay();
             return;
         }
 
-        constexpr uint64_t kUsPerSec = 1000000ULL;
-
-        const uint64_t timeout_us =
-            static_cast<uint64_t>(window_s) * kUsPerSec;
+        start_timer(TimerPhase::ArmDelay,
+                    static_cast<uint64_t>(arm_delay_ms_) * kUsPerMs);
+    }
 
-        err = esp_timer_start_once(disarm_timer_, timeout_us);
-        if (err != ESP_OK)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::schedule_disarm(uint32_t window_ms)
+    {
+        raise(Event::Armed, (state_.taps != 0) ? state_.taps : 1);
+
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+        // The next boot measures the gap itself, so the timer only runs
+        // when an observer waits for the window to close or a pending tap
+        // sequence has a handler to dispatch.
+        if (!observed() &&
+            (pending_taps_ < 2 ||
+             tap_handlers_[pending_taps_].handler == nullptr))
         {
-            ESP_LOGW(TAG,
-                     "esp_timer_start_once(DRD disarm) failed. err=%s",
-                     esp_err_to_name(err));
-            esp_timer_delete(disarm_timer_);
-            disarm_timer_ = nullptr;
+            return;
         }
+#endif
+
+        start_timer(TimerPhase::DisarmWindow,
+                    static_cast<uint64_t>(window_ms) * kUsPerMs);
     }
 
-    void DoubleResetDetector::disarm_timer_cb(void *arg)
+    template <typename Storage, const DrdConfig &Config>
+    void BasicDetector<Storage, Config>::on_arm_delay()
     {
-        auto *self = static_cast<DoubleResetDetector *>(arg);
-        if (self == nullptr)
+        if (!Storage::kTracksFirmware || use_fallback_ || !storage_.ready())
         {
+            ESP_LOGW(TAG,
+                     "DRD arm timer fired but %s backend is not ready",
+                     storage_.source());
             return;
         }
 
-        self->disarm_timer_ = nullptr;
+        ESP_LOGI(TAG,
+                 "DRD arm delay elapsed. Marking firmware clean and arming. "
+                 "window_ms=%" PRIu32,
+                 arm_window_ms_);
+
+        const bool was_dirty = (state_.flags & kFlagDirty) != 0;
+
+        state_.flags =
+            static_cast<uint8_t>((state_.flags & ~kFlagDirty) | kFlagArmed);
+        state_.taps = 1;
+        stamp_arm(state_);
 
-        if (self->backend_ == Backend::RTC)
+        if (store_state("arm callback") != ESP_OK)
         {
-            self->clear_flag();
             return;
         }
 
-        if (!self->nvs_ready_)
+        if (was_dirty)
         {
-            ESP_LOGW(TAG,
-                     "DRD disarm timer fired but NVS backend is not ready");
-            return;
+            raise(Event::FirmwareClean, 0);
         }
 
-        nvs_handle_t h = static_cast<nvs_handle_t>(self->nvs_handle_);
+        // Same timer, next phase.
+        schedule_disarm(arm_window_ms_);
+    }
+
+    template <typename Storage, const DrdConfig &Config>
+    uint8_t BasicDetector<Storage, Config>::on_disarm_window()
+    {
+        const uint8_t taps = pending_taps_;
+        pending_taps_ = 0;
+
+        raise(Event::Disarmed, (state_.taps != 0) ? state_.taps : 1);
 
-        const esp_err_t err = nvs_erase_key(h, kKeyMagic);
-        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+#if !defined(CONFIG_DRD_UPTIME_DETECTION)
+        if (!use_fallback_ && !storage_.ready())
         {
             ESP_LOGW(TAG,
-                     "nvs_erase_key(magic) failed in disarm callback. err=%s",
-                     esp_err_to_name(err));
+                     "DRD disarm timer fired but %s backend is not ready",
+                     storage_.source());
         }
+        else
+        {
+            state_.flags &= static_cast<uint8_t>(~kFlagArmed);
+            state_.taps = 0;
+            (void)store_state("disarm callback");
 
-        const esp_err_t err_commit = nvs_commit(h);
-        if (err_commit != ESP_OK)
+            ESP_LOGI(TAG, "DRD disarm window elapsed. DRD arm flag cleared");
+        }
+#endif
+
+        // The window closed without another reset, so the sequence is
+        // over. The caller dispatches it once the lock is released.
+        if (taps >= 2)
         {
-            ESP_LOGW(TAG,
-                     "nvs_commit() failed in disarm callback. err=%s",
-                     esp_err_to_name(err_commit));
+            ESP_LOGI(TAG,
+                     "DRD tap sequence complete. taps=%u",
+                     static_cast<unsigned>(taps));
         }
 
-        ESP_LOGI(TAG, "DRD disarm window elapsed. DRD magic cleared");
+        return taps;
     }
 
-#if defined(CONFIG_DRD_BACKEND_NVS)
-    static DoubleResetDetector g_detector(Backend::NVS,
-                                          CONFIG_DRD_NVS_NAMESPACE);
+    // Only the Kconfig-selected policy is compiled into the firmware.
+    template class BasicDetector<DefaultStorage>;
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    static DoubleResetDetector g_detector(CONFIG_DRD_NVS_NAMESPACE);
 #else
-    static DoubleResetDetector g_detector(Backend::RTC,
-                                          CONFIG_DRD_NVS_NAMESPACE);
+    static DoubleResetDetector g_detector;
 #endif
 
-    DoubleResetDetector &get()
+    DoubleResetDetector &get(DefaultConfigTag)
     {
         return g_detector;
     }
 
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+    uint8_t early_taps()
+    {
+        return s_early.valid ? s_early.step.taps : 0;
+    }
+#endif
+
 } // namespace drd_handler
+
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+// Runs the RTC state machine in the secondary init stage, before app_main,
+// and publishes the outcome. check_taps() adopts it without evaluating
+// again. It uses the window and policy of drd_handler::kDefaultConfig.
+ESP_SYSTEM_INIT_FN(drd_early_evaluation, SECONDARY, BIT(0), 200)
+{
+    const ResetAction action =
+        reset_action<drd_handler::kDefaultConfig>(esp_reset_reason());
+    if (action == ResetAction::Ignore)
+    {
+        return ESP_OK;
+    }
+
+    drd_handler::RtcStorage storage;
+    drd_handler::StateRecord record{};
+    (void)storage.load(record);
+
+    UntrackedStep step =
+        step_untracked(record, action, drd_handler::kDefaultConfig.window_ms);
+
+    if (step.context != nullptr)
+    {
+        (void)storage.store(record, step.context);
+        step.context = nullptr;
+    }
+
+    s_early.step = step;
+    s_early.valid = true;
+    return ESP_OK;
+}
+
+/// Referenced by the linker so the init function is always kept.
+extern "C" void drd_handler_include_early_evaluation(void)
+{
+}
+#endif
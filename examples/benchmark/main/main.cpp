@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_attr.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <hal/wdt_hal.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <sdkconfig.h>
+#include <soc/rtc.h>
+
+#include "drd_handler.hpp"
+
+namespace
+{
+    constexpr const char *kTag = "drd_bench";
+
+    /// Reset a boot ends with.
+    enum class Scenario : uint8_t
+    {
+        Restart,
+        RtcWdt,
+        DeepSleep
+    };
+
+    constexpr Scenario kScript[] = {
+#if defined(CONFIG_BENCH_RESTART)
+        Scenario::Restart,
+#endif
+#if defined(CONFIG_BENCH_RTC_WDT)
+        Scenario::RtcWdt,
+#endif
+#if defined(CONFIG_BENCH_DEEP_SLEEP)
+        Scenario::DeepSleep,
+#endif
+    };
+
+    constexpr size_t kScenarios = sizeof(kScript) / sizeof(kScript[0]);
+
+    static_assert(kScenarios > 0, "Enable at least one benchmark scenario");
+
+    /// BenchRun::pending once the run has finished.
+    constexpr uint8_t kRunDone = 0xFF;
+    /// BootSample::nvs_used_entries when NVS statistics are unavailable.
+    constexpr uint32_t kEntriesUnknown = UINT32_MAX;
+    /// "BNCH" in little-endian byte order.
+    constexpr uint32_t kRunMagic = 0x48434E42u;
+
+    /// One evaluated boot, written before the boot's scripted reset.
+    struct BootSample
+    {
+        uint8_t reset_reason;      ///< esp_reset_reason_t of the boot.
+        uint8_t taps;              ///< check_taps() result.
+        uint8_t nvs_writes;        ///< DRD NVS writes, with stats enabled.
+        uint8_t nvs_commits;       ///< DRD NVS commits, with stats enabled.
+        uint32_t check_us;         ///< Time spent in the first check_taps().
+        uint32_t write_count;      ///< DRD record writes, cumulative.
+        uint32_t nvs_used_entries; ///< Used entries before the reset.
+    };
+
+    /// Benchmark run kept in RTC memory across the scripted resets.
+    struct BenchRun
+    {
+        uint32_t magic;
+        uint16_t count;   ///< Samples recorded so far.
+        uint8_t pending;  ///< Scenario that ended the last boot.
+        uint8_t reserved; ///< Padding, always zero.
+        BootSample samples[CONFIG_BENCH_CYCLES];
+    };
+
+    RTC_NOINIT_ATTR BenchRun s_run;
+
+    const char *scenario_name(Scenario scenario)
+    {
+        switch (scenario)
+        {
+        case Scenario::Restart:
+            return "esp_restart";
+        case Scenario::RtcWdt:
+            return "rtc_wdt";
+        case Scenario::DeepSleep:
+            return "deep_sleep";
+        }
+        return "unknown";
+    }
+
+    esp_reset_reason_t expected_reason(Scenario scenario)
+    {
+        switch (scenario)
+        {
+        case Scenario::Restart:
+            return ESP_RST_SW;
+        case Scenario::RtcWdt:
+            return ESP_RST_WDT;
+        case Scenario::DeepSleep:
+            return ESP_RST_DEEPSLEEP;
+        }
+        return ESP_RST_UNKNOWN;
+    }
+
+    // Any reset the script did not cause, such as power-on, the button or
+    // flashing, starts a new run.
+    void resume_or_start_run()
+    {
+        const esp_reset_reason_t reason = esp_reset_reason();
+        const bool resumed =
+            s_run.magic == kRunMagic &&
+            s_run.pending <= static_cast<uint8_t>(Scenario::DeepSleep) &&
+            s_run.count < CONFIG_BENCH_CYCLES &&
+            reason == expected_reason(static_cast<Scenario>(s_run.pending));
+
+        if (!resumed)
+        {
+            s_run = {};
+            s_run.magic = kRunMagic;
+            ESP_LOGI(kTag,
+                     "Starting benchmark run. cycles=%d, uptime_ms=%d",
+                     CONFIG_BENCH_CYCLES,
+                     CONFIG_BENCH_UPTIME_MS);
+        }
+    }
+
+    // Only mounts the partition when @p mount is set, which the last boot
+    // does once its sample is taken. The Hybrid backend skips NVS while
+    // its RTC copy is valid, and a mount here would add the very cost it
+    // avoids.
+    uint32_t nvs_used_entries(bool mount)
+    {
+        const char *partition = drd_handler::kDefaultConfig.nvs_partition;
+        if (partition == nullptr)
+        {
+            return kEntriesUnknown;
+        }
+
+        nvs_stats_t stats = {};
+        esp_err_t err = nvs_get_stats(partition, &stats);
+        if (err == ESP_ERR_NVS_NOT_INITIALIZED)
+        {
+            if (!mount)
+            {
+                return kEntriesUnknown;
+            }
+
+            err = nvs_flash_init_partition(partition);
+            if (err == ESP_OK)
+            {
+                err = nvs_get_stats(partition, &stats);
+            }
+        }
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(kTag, "nvs_get_stats failed. err=%s", esp_err_to_name(err));
+            return kEntriesUnknown;
+        }
+
+        return static_cast<uint32_t>(stats.used_entries);
+    }
+
+#if defined(CONFIG_BENCH_RTC_WDT)
+    [[noreturn]] void reset_by_rtc_wdt()
+    {
+        // A system reset keeps RTC memory; an RTC reset would clear it.
+        const uint32_t ticks = static_cast<uint32_t>(
+            static_cast<uint64_t>(CONFIG_BENCH_RTC_WDT_TIMEOUT_MS) *
+            rtc_clk_slow_freq_get_hz() / 1000u);
+
+        wdt_hal_context_t rwdt = RWDT_HAL_CONTEXT_DEFAULT();
+        wdt_hal_write_protect_disable(&rwdt);
+        wdt_hal_config_stage(&rwdt,
+                             WDT_STAGE0,
+                             ticks,
+                             WDT_STAGE_ACTION_RESET_SYSTEM);
+        wdt_hal_enable(&rwdt);
+        wdt_hal_write_protect_enable(&rwdt);
+
+        while (true)
+        {
+            vTaskDelay(portMAX_DELAY);
+        }
+    }
+#endif
+
+    [[noreturn]] void run_scenario(Scenario scenario)
+    {
+        ESP_LOGI(kTag, "Resetting with %s", scenario_name(scenario));
+
+#if defined(CONFIG_BENCH_RTC_WDT)
+        if (scenario == Scenario::RtcWdt)
+        {
+            reset_by_rtc_wdt();
+        }
+#endif
+#if defined(CONFIG_BENCH_DEEP_SLEEP)
+        if (scenario == Scenario::DeepSleep)
+        {
+            esp_sleep_enable_timer_wakeup(
+                static_cast<uint64_t>(CONFIG_BENCH_DEEP_SLEEP_MS) * 1000u);
+            esp_deep_sleep_start();
+        }
+#endif
+
+        esp_restart();
+    }
+
+    /// Reset reasons the report groups boots by.
+    constexpr size_t kReasons = 32;
+
+    /// Summary of the boots that started with one reset reason.
+    struct ReasonSummary
+    {
+        uint32_t boots = 0;
+        uint32_t detections = 0;
+        uint64_t check_us_sum = 0;
+        uint32_t check_us_max = 0;
+        uint32_t nvs_writes = 0;
+        uint32_t nvs_commits = 0;
+    };
+
+    void print_report()
+    {
+        ReasonSummary summaries[kReasons] = {};
+
+        for (uint16_t i = 0; i < s_run.count; ++i)
+        {
+            const BootSample &sample = s_run.samples[i];
+            ReasonSummary &summary =
+                summaries[std::min<size_t>(sample.reset_reason, kReasons - 1)];
+
+            ++summary.boots;
+            summary.detections += (sample.taps >= 2) ? 1 : 0;
+            summary.check_us_sum += sample.check_us;
+            summary.check_us_max = std::max(summary.check_us_max, sample.check_us);
+            summary.nvs_writes += sample.nvs_writes;
+            summary.nvs_commits += sample.nvs_commits;
+        }
+
+        const BootSample &first = s_run.samples[0];
+        const BootSample &last = s_run.samples[s_run.count - 1];
+
+        // Boots that left NVS unmounted carry no entry count.
+        const BootSample *first_known = nullptr;
+        for (uint16_t i = 0; i < s_run.count; ++i)
+        {
+            if (s_run.samples[i].nvs_used_entries != kEntriesUnknown)
+            {
+                first_known = &s_run.samples[i];
+                break;
+            }
+        }
+
+        ESP_LOGI(kTag,
+                 "Benchmark report. backend=%d, boots=%u, window_ms=%" PRIu32
+                 ", arm_delay_ms=%" PRIu32,
+                 static_cast<int>(drd_handler::DoubleResetDetector::kBackend),
+                 static_cast<unsigned>(s_run.count),
+                 drd_handler::kDefaultConfig.window_ms,
+                 drd_handler::kDefaultConfig.arm_delay_ms);
+
+        for (size_t reason = 0; reason < kReasons; ++reason)
+        {
+            const ReasonSummary &summary = summaries[reason];
+            if (summary.boots == 0)
+            {
+                continue;
+            }
+
+            ESP_LOGI(kTag,
+                     "  reason=%u boots=%" PRIu32 " detections=%" PRIu32
+                     " check_us mean=%" PRIu64 " max=%" PRIu32
+                     " nvs_writes=%" PRIu32 " nvs_commits=%" PRIu32,
+                     static_cast<unsigned>(reason),
+                     summary.boots,
+                     summary.detections,
+                     summary.check_us_sum / summary.boots,
+                     summary.check_us_max,
+                     summary.nvs_writes,
+                     summary.nvs_commits);
+        }
+
+        ESP_LOGI(kTag,
+                 "  record writes after the first boot=%" PRIu32,
+                 last.write_count - first.write_count);
+
+        if (first_known != nullptr &&
+            last.nvs_used_entries != kEntriesUnknown)
+        {
+            // Used entries only fall when NVS reclaims a page, so a negative
+            // delta means the run spanned a page erase.
+            ESP_LOGI(kTag,
+                     "  nvs used entries first=%" PRIu32 " last=%" PRIu32
+                     " delta=%" PRId64,
+                     first_known->nvs_used_entries,
+                     last.nvs_used_entries,
+                     static_cast<int64_t>(last.nvs_used_entries) -
+                         static_cast<int64_t>(first_known->nvs_used_entries));
+        }
+    }
+} // namespace
+
+extern "C" void app_main(void)
+{
+    resume_or_start_run();
+
+    const esp_err_t cfg_err = drd_handler::get().configure();
+    if (cfg_err != ESP_OK)
+    {
+        ESP_LOGE(kTag, "drd_handler configure failed: %s", esp_err_to_name(cfg_err));
+    }
+
+    // configure() is timed separately by CONFIG_DRD_ENABLE_STATS; the
+    // benchmark times the evaluation every boot pays.
+    const int64_t start_us = esp_timer_get_time();
+    const uint8_t taps = drd_handler::get().check_taps();
+    const int64_t check_us = esp_timer_get_time() - start_us;
+
+    BootSample &sample = s_run.samples[s_run.count];
+    sample = {};
+    sample.reset_reason = static_cast<uint8_t>(esp_reset_reason());
+    sample.taps = taps;
+    sample.check_us = static_cast<uint32_t>(check_us);
+
+    ESP_LOGI(kTag,
+             "Boot %u/%d. reason=%u, taps=%u, check_us=%" PRIu32,
+             static_cast<unsigned>(s_run.count + 1),
+             CONFIG_BENCH_CYCLES,
+             static_cast<unsigned>(sample.reset_reason),
+             static_cast<unsigned>(taps),
+             sample.check_us);
+
+    // Staying up lets the arm and disarm timers write, so they are counted.
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_BENCH_UPTIME_MS));
+
+#if defined(CONFIG_DRD_ENABLE_STATS)
+    const drd_handler::Stats &stats = drd_handler::get().stats();
+    sample.nvs_writes =
+        static_cast<uint8_t>(std::min<uint32_t>(stats.nvs_writes, UINT8_MAX));
+    sample.nvs_commits =
+        static_cast<uint8_t>(std::min<uint32_t>(stats.nvs_commits, UINT8_MAX));
+#endif
+    sample.write_count = drd_handler::get().write_count();
+    // The last boot has finished measuring itself, so it may mount NVS.
+    const bool last_boot = s_run.count + 1 >= CONFIG_BENCH_CYCLES;
+    sample.nvs_used_entries = nvs_used_entries(last_boot);
+    ++s_run.count;
+
+    if (s_run.count >= CONFIG_BENCH_CYCLES)
+    {
+        s_run.pending = kRunDone;
+        print_report();
+        ESP_LOGI(kTag, "Benchmark done. Reset or power-cycle to run again");
+        return;
+    }
+
+    const Scenario next = kScript[(s_run.count - 1) % kScenarios];
+    s_run.pending = static_cast<uint8_t>(next);
+    run_scenario(next);
+}
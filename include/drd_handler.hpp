@@ -3,30 +3,71 @@
  * @brief Double-reset detection utilities.
  *
  * This component detects a user double-reset event within a configurable
- * time window. It supports two persistence backends:
+ * time window. It supports four persistence backends:
  * - RTC slow memory, for soft-reset style boards.
  * - NVS, for boards where the reset button behaves like power cycling.
+ * - Hybrid, which uses RTC memory and falls back to NVS after power loss.
+ * - Flash, a record ring in a raw data partition that needs no NVS.
  *
- * The NVS backend also suppresses false double-reset detection during
- * firmware flashing by:
+ * The NVS-style backends also suppress false double-reset detection
+ * during firmware flashing by:
  * - Tracking the current application image via the embedded ELF SHA-256.
- * - Treating tooling-style reset reasons as non-user resets.
+ * - A per-reset-reason policy, so tooling, crash or wakeup resets need
+ *   not count as user resets.
+ *
+ * The detector is a class template over a storage policy (RtcStorage,
+ * NvsStorage, HybridStorage or FlashRingStorage). Only the policy selected
+ * in Kconfig is instantiated, so RTC-only builds contain no NVS code at
+ * all.
  *
  * @note
  * Although the DoubleResetDetector type is instantiable, this component
  * is designed to operate as a singleton. A single global instance is
  * provided via drd_handler::get(), and that instance owns all persistent
  * DRD state. Creating additional instances is unsupported and may result
- * in undefined behavior.
+ * in undefined behavior. For several independent reset gestures, enable
+ * CONFIG_DRD_EXTRA_CHANNELS and configure channels on that instance.
  */
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 #include <esp_err.h>
 #include <esp_timer.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_DRD_BACKEND_NVS) || defined(CONFIG_DRD_BACKEND_HYBRID)
+/// Set when the selected backend stores state in NVS.
+#define DRD_HANDLER_HAS_NVS 1
+#endif
+
+#if defined(CONFIG_DRD_EXTRA_CHANNELS) && CONFIG_DRD_EXTRA_CHANNELS > 0
+/// Set when extra detector channels are enabled.
+#define DRD_HANDLER_HAS_CHANNELS 1
+#endif
+
+#if defined(CONFIG_DRD_HISTORY_LENGTH) && CONFIG_DRD_HISTORY_LENGTH > 0
+/// Set when the reset history ring is enabled.
+#define DRD_HANDLER_HAS_HISTORY 1
+#endif
+
+#if defined(CONFIG_DRD_POST_EVENTS)
+#include <esp_event.h>
+
+/// Event base of the detector events posted to the default event loop.
+/// The event id is a drd_handler::Event and the data is the uint8_t taps.
+ESP_EVENT_DECLARE_BASE(DRD_EVENT);
+#endif
+
 /// Double-reset detection utilities.
 namespace drd_handler
 {
@@ -35,59 +76,745 @@ namespace drd_handler
      * @brief Backend storage used for double reset detection.
      *
      * RTC uses RTC slow memory. NVS uses non-volatile storage to persist
-     * state across more reset types.
+     * state across more reset types. Hybrid keeps state in RTC memory and
+     * only touches NVS when the RTC copy does not survive the reset. Flash
+     * appends records to a raw data partition without NVS.
      */
     enum class Backend : uint8_t
     {
-        RTC, ///< Use RTC slow memory.
-        NVS  ///< Use NVS namespace.
+        RTC,    ///< Use RTC slow memory.
+        NVS,    ///< Use NVS namespace.
+        Hybrid, ///< Use RTC memory, falling back to NVS when it is invalid.
+        Flash   ///< Use a record ring in a raw flash partition.
+    };
+
+    /**
+     * @brief Effect of a reset reason on the tap sequence.
+     *
+     * Each reason is mapped at compile time by the CONFIG_DRD_RESET_*_MASK
+     * options, one bit per esp_reset_reason_t value. A reason in several
+     * masks takes the first of Ignore, DelayArm and Clear.
+     */
+    enum class ResetAction : uint8_t
+    {
+        Count,    ///< User reset: starts or extends a tap sequence.
+        Ignore,   ///< Not evaluated; storage, record and timers untouched.
+        Clear,    ///< Ends any sequence and opens no window this boot.
+        DelayArm  ///< Ends any sequence and arms after the arm delay.
+    };
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    /// Detector channels besides the primary one, from Kconfig.
+    inline constexpr uint8_t kExtraChannels = CONFIG_DRD_EXTRA_CHANNELS;
+
+    /// Tap sequence of one extra channel, kept in the state record.
+    struct ChannelState
+    {
+        uint8_t flags;        ///< Arm flag bit.
+        uint8_t taps;         ///< Resets in the open sequence.
+        uint16_t reserved;    ///< Padding, always zero.
+        uint32_t armed_at_ms; ///< RTC clock when armed, uptime mode only.
+    };
+
+    /**
+     * @brief Configuration of an extra detector channel.
+     *
+     * A channel counts the resets whose reason is in @ref reset_mask. Any
+     * other evaluated reset ends its sequence. A non-zero @ref window_ms
+     * takes the place of @ref window_s for sub-second windows.
+     */
+    struct ChannelConfig
+    {
+        uint32_t window_s = 0;   ///< Window after each counted boot.
+        uint32_t reset_mask = 0; ///< One bit per esp_reset_reason_t.
+        uint8_t max_taps = 0;    ///< Sequence length that completes, >= 2.
+        uint32_t window_ms = 0;  ///< Window in milliseconds, 0 for window_s.
+    };
+#endif
+
+#if defined(CONFIG_DRD_IDENTITY_SHA256_64)
+    /// Leading bytes of the app ELF SHA-256 kept as firmware identity.
+    inline constexpr size_t kIdentityLen = 8;
+#else
+    inline constexpr size_t kIdentityLen = 32;
+#endif
+
+    /**
+     * @brief Packed DRD state persisted by the NVS, Hybrid and Flash
+     * backends.
+     *
+     * The whole record is stored as one blob so a boot costs a single
+     * record read and at most one write. The Hybrid backend keeps a copy of
+     * the same record in RTC memory. The CRC covers every field that
+     * precedes it. The type is trivial so it can live in RTC no-init
+     * memory; value-initialize it to get an empty record.
+     */
+    struct StateRecord
+    {
+        uint32_t magic;          ///< Record marker (kStateMagic).
+        uint8_t version;         ///< Record layout version.
+        uint8_t flags;           ///< State flag bits.
+        uint8_t taps;            ///< Resets in the open tap sequence.
+        uint8_t reserved;        ///< Padding, always zero.
+        uint32_t boot_count;     ///< Boots that updated the record.
+        uint32_t write_count;    ///< Cumulative record writes.
+        uint8_t app_sha256[kIdentityLen]; ///< Firmware identity.
+        uint32_t armed_at_ms;    ///< RTC clock when armed, uptime mode only.
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        ChannelState channels[kExtraChannels]; ///< Extra detector channels.
+#endif
+        uint32_t crc;            ///< CRC-32 of the fields above.
+    };
+
+    /**
+     * @brief Completion callback for asynchronous evaluation.
+     *
+     * Runs on the DRD evaluation task, or on the caller's task when the
+     * result was already cached.
+     *
+     * @param double_reset true if a double reset was detected.
+     * @param arg          User argument passed to check_and_clear_async().
+     */
+    using ResultCallback = void (*)(bool double_reset, void *arg);
+
+#if defined(CONFIG_DRD_MAX_TAPS)
+    /// Longest tap sequence that is counted, from Kconfig.
+    inline constexpr uint8_t kMaxTaps = CONFIG_DRD_MAX_TAPS;
+#else
+    inline constexpr uint8_t kMaxTaps = 2;
+#endif
+
+#if defined(CONFIG_DRD_WINDOW_MS) && CONFIG_DRD_WINDOW_MS > 0
+    /// Detection window used without an explicit one, in milliseconds.
+    inline constexpr uint32_t kWindowMs = CONFIG_DRD_WINDOW_MS;
+#else
+    inline constexpr uint32_t kWindowMs =
+        static_cast<uint32_t>(CONFIG_DRD_WINDOW_SECONDS) * 1000u;
+#endif
+
+#if defined(CONFIG_DRD_ARM_DELAY_MS) && CONFIG_DRD_ARM_DELAY_MS > 0
+    /// Delay before arming after a dirty or tooling boot, in milliseconds.
+    inline constexpr uint32_t kArmDelayMs = CONFIG_DRD_ARM_DELAY_MS;
+#else
+    inline constexpr uint32_t kArmDelayMs =
+        static_cast<uint32_t>(CONFIG_DRD_ARM_DELAY_SECONDS) * 1000u;
+#endif
+
+    /// DrdConfig::log_level that leaves the DRD log level alone.
+    inline constexpr int kLogLevelUnchanged = -1;
+
+    /**
+     * @brief Compile-time settings of a detector type.
+     *
+     * Collects what the detector reads while evaluating a boot, so a fleet
+     * can pin its production settings in one constant. BasicDetector takes
+     * the constant by reference, which makes every field a constant
+     * expression; unused policy branches fold away as they do for
+     * Kconfig options. Build-time features such as the tap count,
+     * channels and history stay in Kconfig.
+     */
+    struct DrdConfig
+    {
+        uint32_t window_ms;      ///< Window used without an explicit one.
+        uint32_t arm_delay_ms;   ///< Delay before arming after a dirty or
+                                 ///< tooling boot.
+        uint32_t ignore_mask;    ///< Reasons mapped to ResetAction::Ignore.
+        uint32_t delay_arm_mask; ///< Reasons mapped to DelayArm.
+        uint32_t clear_mask;     ///< Reasons mapped to ResetAction::Clear.
+        Backend backend;         ///< Must match the storage policy.
+        /// NVS partition of the NVS and Hybrid backends. Borrowed.
+        const char *nvs_partition;
+        /// esp_log_level_t set on the DRD tag by configure(), or
+        /// kLogLevelUnchanged. Logs emitted before configure(), such as
+        /// those of the early evaluation hook, use the level in effect.
+        int log_level;
+    };
+
+#if defined(DRD_HANDLER_CONFIG)
+    /// Settings of DoubleResetDetector, from the DRD_HANDLER_CONFIG
+    /// initializer defined at build time instead of Kconfig. It must be
+    /// defined identically for the component and every file including
+    /// this header; DefaultConfigTag makes a mismatch fail to link.
+    inline constexpr DrdConfig kDefaultConfig = DRD_HANDLER_CONFIG;
+#else
+    /// Settings of DoubleResetDetector, from Kconfig.
+    inline constexpr DrdConfig kDefaultConfig = {
+        kWindowMs,
+        kArmDelayMs,
+        CONFIG_DRD_RESET_IGNORE_MASK,
+        CONFIG_DRD_RESET_DELAY_ARM_MASK,
+        CONFIG_DRD_RESET_CLEAR_MASK,
+#if defined(CONFIG_DRD_BACKEND_NVS)
+        Backend::NVS,
+#elif defined(CONFIG_DRD_BACKEND_HYBRID)
+        Backend::Hybrid,
+#elif defined(CONFIG_DRD_BACKEND_FLASH)
+        Backend::Flash,
+#else
+        Backend::RTC,
+#endif
+#if defined(DRD_HANDLER_HAS_NVS)
+        CONFIG_DRD_NVS_PARTITION,
+#else
+        nullptr,
+#endif
+        kLogLevelUnchanged,
+    };
+#endif
+
+    /// FNV-1a hash of a string usable in constant expressions, 0 for null.
+    constexpr uint32_t config_string_hash(const char *text)
+    {
+        if (text == nullptr)
+        {
+            return 0;
+        }
+
+        uint32_t hash = 2166136261u;
+        for (; *text != '\0'; ++text)
+        {
+            hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619u;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief A DrdConfig's values, encoded in a type.
+     *
+     * get() and the BasicDetector constructor take one as a defaulted
+     * parameter, so their mangled names carry the settings as each
+     * translation unit sees them. A file built with a DRD_HANDLER_CONFIG
+     * that differs from the component's, which would silently break the
+     * one-definition rule, fails to link instead.
+     */
+    template <uint32_t WindowMs,
+              uint32_t ArmDelayMs,
+              uint32_t IgnoreMask,
+              uint32_t DelayArmMask,
+              uint32_t ClearMask,
+              Backend ConfigBackend,
+              uint32_t PartitionHash,
+              int LogLevel>
+    struct ConfigTag
+    {
+    };
+
+    /// ConfigTag of a DrdConfig with static storage duration.
+    template <const DrdConfig &C>
+    using ConfigTagOf = ConfigTag<C.window_ms,
+                                  C.arm_delay_ms,
+                                  C.ignore_mask,
+                                  C.delay_arm_mask,
+                                  C.clear_mask,
+                                  C.backend,
+                                  config_string_hash(C.nvs_partition),
+                                  C.log_level>;
+
+    /// ConfigTag of kDefaultConfig.
+    using DefaultConfigTag = ConfigTagOf<kDefaultConfig>;
+
+    /**
+     * @brief Handler for a completed tap sequence.
+     *
+     * @param taps Number of consecutive resets in the sequence.
+     * @param arg  User argument passed to register_tap_handler().
+     */
+    using TapHandler = void (*)(uint8_t taps, void *arg);
+
+    /**
+     * @brief Detector transition reported to observers.
+     *
+     * Events raised by one evaluation or one timer expiry are delivered
+     * together, in the order they occurred, once the detector lock has
+     * been released.
+     */
+    enum class Event : uint8_t
+    {
+        Armed,         ///< A window opened; taps is the count so far.
+        Disarmed,      ///< The window closed; taps is the final count.
+        Detected,      ///< A reset extended the sequence; taps is the count.
+        FirmwareDirty, ///< Firmware not yet trusted; arming is delayed.
+        FirmwareClean  ///< Arm delay elapsed; the firmware is trusted.
+    };
+
+    /**
+     * @brief Observer for detector transitions.
+     *
+     * Runs on the task that called check_taps(), or on the esp_timer task
+     * for transitions driven by the arm and disarm timers.
+     *
+     * @param event Transition that occurred.
+     * @param taps  Tap count for the event, 0 for firmware events.
+     * @param arg   User argument passed to set_event_callback().
+     */
+    using EventCallback = void (*)(Event event, uint8_t taps, void *arg);
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    /// Evaluated boots kept in the reset history, from Kconfig.
+    inline constexpr uint8_t kHistoryLength = CONFIG_DRD_HISTORY_LENGTH;
+
+    /// HistoryEntry::gap_s when the gap is not known.
+    inline constexpr uint32_t kHistoryGapUnknown = 0xFFFFFu;
+
+    /**
+     * @brief One evaluated boot of the reset history.
+     *
+     * Decoded from a 32-bit packed entry kept in RTC memory. Boots whose
+     * reason maps to ResetAction::Ignore are not recorded.
+     */
+    struct HistoryEntry
+    {
+        uint8_t reset_reason; ///< esp_reset_reason_t of the boot.
+        ResetAction action;   ///< Policy applied to the reason.
+        uint8_t taps;         ///< check_taps() result of the boot.
+        bool firmware_dirty;  ///< Firmware was not yet trusted.
+        /// Seconds since the previous entry's evaluation, which covers
+        /// that boot's uptime and any deep sleep since. Capped just below
+        /// kHistoryGapUnknown, which marks a restarted RTC clock.
+        uint32_t gap_s;
+    };
+#endif
+
+#if defined(CONFIG_DRD_ENABLE_STATS)
+    /**
+     * @brief Boot-time cost of the DRD path.
+     *
+     * Durations are measured with esp_timer_get_time() and accumulate over
+     * the boot. Only available when CONFIG_DRD_ENABLE_STATS is set.
+     */
+    struct Stats
+    {
+        int64_t configure_us = 0;    ///< Total time spent in configure().
+        int64_t nvs_init_us = 0;     ///< Time spent in nvs_flash_init().
+        int64_t nvs_open_us = 0;     ///< Time spent in nvs_open().
+        int64_t check_us = 0;        ///< First check_and_clear() call.
+        int64_t nvs_read_us = 0;     ///< Time spent in nvs_get_*().
+        int64_t nvs_write_us = 0;    ///< Time in nvs_set_*() and erases.
+        int64_t nvs_commit_us = 0;   ///< Time spent in nvs_commit().
+        int64_t timer_create_us = 0; ///< Time spent in esp_timer_create().
+        uint32_t nvs_reads = 0;      ///< Number of nvs_get_*() calls.
+        uint32_t nvs_writes = 0;     ///< Number of set and erase calls.
+        uint32_t nvs_commits = 0;    ///< Number of nvs_commit() calls.
+        uint32_t timer_creates = 0;  ///< Number of esp_timer_create() calls.
+    };
+#endif
+
+    /**
+     * @brief Storage policy that keeps the state record in RTC memory.
+     *
+     * The record lives in RTC no-init memory and is validated by its CRC,
+     * so it survives soft resets and deep sleep but not power loss. This
+     * policy does not track firmware identity.
+     *
+     * Every storage policy provides the same interface, which
+     * BasicDetector calls directly with no virtual dispatch.
+     */
+    class RtcStorage
+    {
+    public:
+        /// Backend reported for this policy.
+        static constexpr Backend kBackend = Backend::RTC;
+        /// Whether the detector tracks firmware identity and dirty state.
+        static constexpr bool kTracksFirmware = false;
+
+        /// The arguments are unused; accepted for a uniform constructor.
+        explicit RtcStorage(const char *nvs_namespace = nullptr,
+                            const char *nvs_partition = nullptr);
+
+        /// Prepare the storage. Always succeeds for RTC memory.
+        esp_err_t open();
+
+        /// Whether load() and store() can be used.
+        [[nodiscard]] bool ready() const
+        {
+            return true;
+        }
+
+        /// Name of the medium the current state came from, for logging.
+        [[nodiscard]] const char *source() const
+        {
+            return "RTC";
+        }
+
+        /// Whether load() left work that requires a record write.
+        [[nodiscard]] bool pending_write() const
+        {
+            return false;
+        }
+
+        /**
+         * @brief Read the stored record.
+         *
+         * @param record Receives the record, or an empty record on error.
+         *
+         * @return ESP_OK, or ESP_ERR_NOT_FOUND if no valid record exists.
+         */
+        esp_err_t load(StateRecord &record);
+
+        /**
+         * @brief Seal and store the record.
+         *
+         * @param record  Record to store; sealed in place.
+         * @param context Short description used in log messages.
+         *
+         * @return ESP_OK on success or an ESP-IDF error code.
+         */
+        esp_err_t store(StateRecord &record, const char *context);
+
+        /// Remove all stored DRD state.
+        esp_err_t erase();
+    };
+
+#if defined(DRD_HANDLER_HAS_NVS)
+    /**
+     * @brief Storage policy that keeps the state record in NVS.
+     *
+     * The record is one blob, so a boot costs a single read and at most
+     * one write. Legacy per-key state from earlier releases is migrated
+     * on the first load. Writes are coalesced and budgeted per boot
+     * according to Kconfig.
+     */
+    class NvsStorage
+    {
+    public:
+        static constexpr Backend kBackend = Backend::NVS;
+        static constexpr bool kTracksFirmware = true;
+
+        /**
+         * @param nvs_namespace Borrowed, usually a static string literal.
+         * @param nvs_partition Borrowed partition label, or nullptr for
+         *                      CONFIG_DRD_NVS_PARTITION.
+         */
+        explicit NvsStorage(const char *nvs_namespace,
+                            const char *nvs_partition = nullptr);
+
+        /// Closes the NVS handle if it is open.
+        ~NvsStorage();
+
+        NvsStorage(const NvsStorage &) = delete;
+        NvsStorage &operator=(const NvsStorage &) = delete;
+
+        /// Initialize the NVS partition (without erasing data) and open
+        /// the namespace. Does nothing once a handle is open or adopted.
+        esp_err_t open();
+
+        /**
+         * @brief Use an NVS handle opened by the application.
+         *
+         * open() then skips partition initialization, and the destructor
+         * leaves the handle open.
+         *
+         * @param handle nvs_handle_t opened with NVS_READWRITE.
+         *
+         * @return ESP_OK on success.
+         * @return ESP_ERR_INVALID_STATE if a handle is already open.
+         */
+        esp_err_t adopt(uint32_t handle);
+
+        [[nodiscard]] bool ready() const
+        {
+            return ready_;
+        }
+
+        [[nodiscard]] const char *source() const
+        {
+            return "NVS";
+        }
+
+        /// True after load() migrated legacy keys into a pending record.
+        [[nodiscard]] bool pending_write() const
+        {
+            return migrated_;
+        }
+
+        esp_err_t load(StateRecord &record);
+        esp_err_t store(StateRecord &record, const char *context);
+        esp_err_t erase();
+
+        /// Last record known to be in NVS, or nullptr if there is none.
+        [[nodiscard]] const StateRecord *persisted() const
+        {
+            return persisted_valid_ ? &persisted_ : nullptr;
+        }
+
+        /// Adopt a record known to be in NVS without reading it.
+        void assume_persisted(const StateRecord *record);
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        /// Read the reset history blob into @p data, exactly @p len bytes.
+        esp_err_t load_history(void *data, size_t len);
+
+        /// Write the reset history blob. Commits like a record write.
+        esp_err_t store_history(const void *data, size_t len);
+#endif
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        /// While enabled, store() stages the record in memory unless it
+        /// clears a persisted arm flag or changes an armed tap count. A
+        /// store() that writes drops the staged one.
+        void defer(bool enabled)
+        {
+            defer_ = enabled;
+        }
+
+        /// Write the staged record, if any. An adopted handle is left for
+        /// the application to commit.
+        esp_err_t flush();
+#endif
+
+    private:
+        /// Borrowed pointer, usually a static string literal.
+        const char *nvs_namespace_ = "drd";
+        /// Borrowed partition label.
+        const char *nvs_partition_ = nullptr;
+        bool ready_ = false;
+        /// NVS handle stored as an integer; valid only when ready_ is true.
+        uint32_t handle_ = 0;
+        /// handle_ was opened by open() and is closed by the destructor.
+        bool owns_handle_ = false;
+
+        /// load() found legacy keys and staged their erasure.
+        bool migrated_ = false;
+        /// Last record known to be on flash; valid when persisted_valid_.
+        StateRecord persisted_{};
+        bool persisted_valid_ = false;
+        /// Record writes issued since boot, checked against the budget.
+        uint32_t writes_this_boot_ = 0;
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+        bool defer_ = false;
+        /// Sealed record waiting for flush(); valid when staged_valid_.
+        StateRecord staged_{};
+        bool staged_valid_ = false;
+#endif
+
+        esp_err_t migrate_legacy(StateRecord &record);
+        esp_err_t write_record(const StateRecord &record,
+                               const char *context,
+                               bool commit);
+    };
+
+    /**
+     * @brief Storage policy that keeps state in RTC memory, backed by NVS.
+     *
+     * When the RTC copy survives the reset, the boot is evaluated without
+     * touching NVS. Otherwise it behaves like NvsStorage and refreshes the
+     * RTC copy.
+     */
+    class HybridStorage
+    {
+    public:
+        static constexpr Backend kBackend = Backend::Hybrid;
+        static constexpr bool kTracksFirmware = true;
+
+        /// Arguments as for NvsStorage.
+        explicit HybridStorage(const char *nvs_namespace,
+                               const char *nvs_partition = nullptr);
+
+        /// Validate the RTC copy; open NVS only if it is invalid.
+        esp_err_t open();
+
+        /// Use an NVS handle opened by the application, see NvsStorage.
+        esp_err_t adopt(uint32_t handle)
+        {
+            return nvs_.adopt(handle);
+        }
+
+        [[nodiscard]] bool ready() const
+        {
+            return rtc_sourced_ || nvs_.ready();
+        }
+
+        [[nodiscard]] const char *source() const
+        {
+            return rtc_sourced_ ? "RTC" : "NVS";
+        }
+
+        [[nodiscard]] bool pending_write() const
+        {
+            return !rtc_sourced_ && nvs_.pending_write();
+        }
+
+        esp_err_t load(StateRecord &record);
+        esp_err_t store(StateRecord &record, const char *context);
+        esp_err_t erase();
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        /// Reset history in NVS, see NvsStorage. Opens NVS if needed.
+        esp_err_t load_history(void *data, size_t len);
+        esp_err_t store_history(const void *data, size_t len);
+#endif
+
+    private:
+        NvsStorage nvs_;
+        /// This boot's state was restored from RTC memory.
+        bool rtc_sourced_ = false;
     };
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_FLASH)
+    /**
+     * @brief Storage policy that appends records to a raw flash ring.
+     *
+     * Records go into fixed-size slots of a dedicated data partition
+     * through esp_partition_write(), and a sector is erased only when the
+     * ring wraps onto it. Each sector starts with a bitmap of claimed
+     * slots, so the newest record is found with one bitmap read and one
+     * record read. NVS is never initialized.
+     */
+    class FlashRingStorage
+    {
+    public:
+        static constexpr Backend kBackend = Backend::Flash;
+        static constexpr bool kTracksFirmware = true;
+
+        /// The arguments are unused; accepted for a uniform constructor.
+        explicit FlashRingStorage(const char *nvs_namespace = nullptr,
+                                  const char *nvs_partition = nullptr);
+
+        /// Find the partition and the sector holding the newest record.
+        esp_err_t open();
+
+        [[nodiscard]] bool ready() const
+        {
+            return ready_;
+        }
+
+        [[nodiscard]] const char *source() const
+        {
+            return "flash";
+        }
+
+        [[nodiscard]] bool pending_write() const
+        {
+            return false;
+        }
+
+        esp_err_t load(StateRecord &record);
+        esp_err_t store(StateRecord &record, const char *context);
+        esp_err_t erase();
+
+    private:
+        bool ready_ = false;
+        /// Number of sectors in the partition.
+        uint32_t sectors_ = 0;
+        /// Sector that holds the newest record, and its sequence number.
+        uint32_t sector_ = 0;
+        uint32_t sequence_ = 0;
+        /// Slots claimed in the current sector.
+        uint32_t claimed_ = 0;
+        /// No sector has been started since the partition was erased.
+        bool empty_ = true;
+
+        /// Last record known to be on flash; valid when persisted_valid_.
+        StateRecord persisted_{};
+        bool persisted_valid_ = false;
+        /// Record writes issued since boot, checked against the budget.
+        uint32_t writes_this_boot_ = 0;
+
+        esp_err_t append(const StateRecord &record);
+        esp_err_t start_sector(uint32_t sector, const StateRecord &record);
+    };
+#endif
 
     /**
      * @brief Detects double reset events within a configurable time window.
      *
-     * The detector tracks state across resets using either RTC slow memory
-     * or NVS, depending on the selected backend. The first call in a boot
-     * evaluates the double reset condition and caches the result so later
-     * calls are inexpensive.
+     * The detector tracks state across resets through its Storage policy.
+     * The first call in a boot evaluates the double reset condition and
+     * caches the result so later calls are inexpensive.
+     *
+     * All members may be called from any task. Evaluation runs once, under
+     * a recursive mutex that also serializes the timer callback and
+     * clear_flag(); a concurrent caller waits for that evaluation rather
+     * than starting its own. Once the result is published, reads are a
+     * single atomic load and never take the mutex. Tap handlers and
+     * completion callbacks run with the mutex released.
+     *
+     * Member functions are defined in drd_handler.cpp and instantiated
+     * only for DefaultStorage, the policy selected in Kconfig, with
+     * kDefaultConfig. Define DRD_HANDLER_CONFIG for the component to
+     * build it with other settings.
+     *
+     * @tparam Storage RtcStorage, NvsStorage, HybridStorage or
+     *                 FlashRingStorage.
+     * @tparam Config  Settings with static storage duration, whose backend
+     *                 matches the storage policy.
      */
-    class DoubleResetDetector
+    template <typename Storage, const DrdConfig &Config = kDefaultConfig>
+    class BasicDetector
     {
+        static_assert(Config.backend == Storage::kBackend,
+                      "DrdConfig backend does not match the storage policy");
+
     public:
+        /// Backend implemented by the storage policy.
+        static constexpr Backend kBackend = Storage::kBackend;
+        /// Settings this detector type was built with.
+        static constexpr const DrdConfig &kConfig = Config;
+
         /**
-         * @brief Construct a detector with the given backend.
+         * @brief Construct a detector.
          *
-         * @param backend       Storage backend to use.
-         * @param nvs_namespace NVS namespace for state when backend is NVS.
+         * @param nvs_namespace NVS namespace for state when the storage
+         *                      policy uses NVS. Ignored otherwise.
+         *
+         * The unnamed parameter only ties the caller to the settings the
+         * component was built with, see ConfigTag; never pass it.
          */
-        explicit DoubleResetDetector(Backend backend,
-                                     const char *nvs_namespace = "drd");
+        explicit BasicDetector(const char *nvs_namespace = "drd",
+                               ConfigTagOf<Config> = {});
 
-        /// Destructor cleans up any active timers.
-        ~DoubleResetDetector();
+        /// Destructor stops and deletes the DRD timer.
+        ~BasicDetector();
 
-        DoubleResetDetector(const DoubleResetDetector &) = delete;
-        DoubleResetDetector &operator=(const DoubleResetDetector &) = delete;
+        BasicDetector(const BasicDetector &) = delete;
+        BasicDetector &operator=(const BasicDetector &) = delete;
 
-        DoubleResetDetector(DoubleResetDetector &&) = delete;
-        DoubleResetDetector &operator=(DoubleResetDetector &&) = delete;
+        BasicDetector(BasicDetector &&) = delete;
+        BasicDetector &operator=(BasicDetector &&) = delete;
 
         /**
          * @brief Configure the detector backend.
          *
-         * For the NVS backend this initializes NVS (without erasing data)
-         * and opens the configured namespace. For the RTC backend this
-         * performs no special work.
+         * For the NVS backend this initializes Config.nvs_partition
+         * (without erasing data) and opens the configured namespace,
+         * unless use_nvs_handle() supplied a handle. For the Hybrid
+         * backend this only happens when the RTC copy is invalid. For the
+         * RTC backend this performs no special work.
+         *
+         * The DRD timers are created here too. With
+         * CONFIG_DRD_STATIC_ALLOCATION this is the only call that
+         * allocates, so call it during init; the Hybrid backend then opens
+         * NVS here as well, and later calls never create a timer.
          *
          * @return ESP_OK on success or an ESP-IDF error code.
          */
         esp_err_t configure();
 
+        /**
+         * @brief Keep DRD state in an NVS handle owned by the application.
+         *
+         * configure() then neither initializes an NVS partition nor opens
+         * a namespace, and DRD never closes the handle. The handle must
+         * stay open for the lifetime of the detector, including disarm
+         * writes from the timer after the first evaluation.
+         *
+         * @param handle nvs_handle_t opened with NVS_READWRITE.
+         *
+         * @return ESP_OK on success.
+         * @return ESP_ERR_INVALID_STATE if called after configure().
+         * @return ESP_ERR_NOT_SUPPORTED for backends that do not use NVS.
+         */
+        esp_err_t use_nvs_handle(uint32_t handle);
+
         /**
          * @brief Check and clear using the configured window.
          *
-         * Uses CONFIG_DRD_WINDOW_SECONDS from Kconfig as the detection
-         * window. The result is cached for the remainder of the boot.
+         * Uses DrdConfig::window_ms, by default kWindowMs from
+         * CONFIG_DRD_WINDOW_MS or CONFIG_DRD_WINDOW_SECONDS, as the
+         * detection window. The result is cached for the remainder of
+         * the boot.
          *
          * @return true if a double reset was detected.
          * @return false otherwise.
@@ -108,55 +835,477 @@ namespace drd_handler
          */
         [[nodiscard]] bool check_and_clear(uint32_t window_s);
 
+        /**
+         * @brief Check and clear using a window in milliseconds.
+         *
+         * Same as check_and_clear(uint32_t), for windows that match the
+         * speed of a quick double tap.
+         *
+         * @param window_ms Detection window in milliseconds.
+         *
+         * @return true if a double reset was detected.
+         * @return false otherwise.
+         */
+        [[nodiscard]] bool check_and_clear_ms(uint32_t window_ms);
+
+        /**
+         * @brief Count consecutive resets using the configured window.
+         *
+         * @return Number of consecutive resets, see check_taps(uint32_t).
+         */
+        [[nodiscard]] uint8_t check_taps();
+
+        /**
+         * @brief Count consecutive resets using an explicit window.
+         *
+         * Each reset that arrives within @p window_s of the previous boot
+         * extends the tap sequence. A sequence that reaches kMaxTaps ends
+         * immediately; shorter sequences end when the window elapses with
+         * no further reset. check_and_clear() reports true for any count
+         * of two or more.
+         *
+         * @param window_s Detection window in seconds.
+         *
+         * @return 1 for an isolated boot, up to kMaxTaps for a sequence,
+         *         or 0 if detection was skipped, which includes resets
+         *         whose reason maps to ResetAction::Ignore.
+         */
+        [[nodiscard]] uint8_t check_taps(uint32_t window_s);
+
+        /**
+         * @brief Count consecutive resets using a window in milliseconds.
+         *
+         * Same as check_taps(uint32_t). The disarm timer and the uptime
+         * gap are both resolved to the millisecond, so a short window
+         * also shortens the time the record stays armed.
+         *
+         * @param window_ms Detection window in milliseconds.
+         *
+         * @return Number of consecutive resets, see check_taps(uint32_t).
+         */
+        [[nodiscard]] uint8_t check_taps_ms(uint32_t window_ms);
+
+        /**
+         * @brief Register a handler for a tap count.
+         *
+         * The handler runs once the sequence has ended with exactly
+         * @p taps resets. A sequence of kMaxTaps is dispatched from
+         * check_taps() on the calling task; shorter sequences are
+         * dispatched from the esp_timer task when the window elapses.
+         * Register handlers before the first evaluation.
+         *
+         * @param taps    Tap count, from 2 to kMaxTaps.
+         * @param handler Handler to run, or nullptr to remove it.
+         * @param arg     User argument passed to @p handler.
+         *
+         * @return ESP_OK on success.
+         * @return ESP_ERR_INVALID_ARG if @p taps is out of range.
+         * @return ESP_ERR_INVALID_STATE if this boot was already evaluated.
+         */
+        esp_err_t register_tap_handler(uint8_t taps,
+                                       TapHandler handler,
+                                       void *arg = nullptr);
+
+        /**
+         * @brief Register an observer for arm, disarm, detection and
+         * firmware transitions.
+         *
+         * Lets a consumer such as a status LED follow the window without
+         * polling. Register before the first evaluation. With
+         * CONFIG_DRD_UPTIME_DETECTION the disarm timer then runs so that
+         * Event::Disarmed is delivered, but it writes nothing.
+         *
+         * @param callback Observer to run, or nullptr to remove it.
+         * @param arg      User argument passed to @p callback.
+         *
+         * @return ESP_OK on success.
+         * @return ESP_ERR_INVALID_STATE if this boot was already evaluated.
+         */
+        esp_err_t set_event_callback(EventCallback callback,
+                                     void *arg = nullptr);
+
+        /**
+         * @brief Evaluate on a background task and report via a callback.
+         *
+         * Starts a low-priority task that runs check_and_clear(window_s)
+         * and then invokes @p callback with the result. If the boot was
+         * already evaluated, the callback runs immediately on the calling
+         * task.
+         *
+         * Other tasks may call check_and_clear() meanwhile; they wait
+         * for the same evaluation and see the same result.
+         *
+         * @param window_s Detection window in seconds.
+         * @param callback Completion callback, may be nullptr.
+         * @param arg      User argument passed to @p callback.
+         *
+         * @return ESP_OK if evaluation was started or already complete.
+         * @return ESP_ERR_INVALID_STATE if an evaluation is in progress.
+         * @return ESP_ERR_NO_MEM if the task could not be created.
+         */
+        esp_err_t check_and_clear_async(uint32_t window_s,
+                                        ResultCallback callback,
+                                        void *arg = nullptr);
+
+        /**
+         * @brief Evaluate on a background task with a window in
+         * milliseconds and report via a callback.
+         *
+         * Same as check_and_clear_async(uint32_t, ResultCallback, void *).
+         *
+         * @param window_ms Detection window in milliseconds.
+         * @param callback  Completion callback, may be nullptr.
+         * @param arg       User argument passed to @p callback.
+         *
+         * @return See check_and_clear_async().
+         */
+        esp_err_t check_and_clear_async_ms(uint32_t window_ms,
+                                           ResultCallback callback,
+                                           void *arg = nullptr);
+
+        /**
+         * @brief Evaluate on a background task and report via event bits.
+         *
+         * Like the callback overload, but sets @p done_bits in @p group
+         * once the result is available, together with @p detected_bits
+         * when a double reset was detected. Waiters can block with
+         * xEventGroupWaitBits() on @p done_bits.
+         *
+         * @param window_s      Detection window in seconds.
+         * @param group         Event group to signal, must not be nullptr.
+         * @param done_bits     Bits set when evaluation completes.
+         * @param detected_bits Bits also set when a double reset occurred.
+         *
+         * @return ESP_OK if evaluation was started or already complete.
+         * @return ESP_ERR_INVALID_ARG if @p group or @p done_bits is empty.
+         * @return ESP_ERR_INVALID_STATE if an evaluation is in progress.
+         * @return ESP_ERR_NO_MEM if the task could not be created.
+         */
+        esp_err_t check_and_clear_async(uint32_t window_s,
+                                        EventGroupHandle_t group,
+                                        EventBits_t done_bits,
+                                        EventBits_t detected_bits);
+
+        /**
+         * @brief Evaluate on a background task with a window in
+         * milliseconds and report via event bits.
+         *
+         * Same as the event group overload of check_and_clear_async().
+         *
+         * @param window_ms     Detection window in milliseconds.
+         * @param group         Event group to signal, must not be nullptr.
+         * @param done_bits     Bits set when evaluation completes.
+         * @param detected_bits Bits also set when a double reset occurred.
+         *
+         * @return See check_and_clear_async().
+         */
+        esp_err_t check_and_clear_async_ms(uint32_t window_ms,
+                                           EventGroupHandle_t group,
+                                           EventBits_t done_bits,
+                                           EventBits_t detected_bits);
+
+        /**
+         * @brief Write state staged by CONFIG_DRD_DEFERRED_COMMIT.
+         *
+         * With deferred commits, the arm and bookkeeping writes made while
+         * evaluating stay in memory until this is called, so the
+         * application decides when flash is touched. A reset before then
+         * loses them, and the next boot sees the previous record. Writes
+         * that clear a stored arm flag or change an armed tap count are
+         * never deferred, and neither are writes from the timer. With a
+         * handle passed to use_nvs_handle(), the record is written but the
+         * commit is left to the application's own nvs_commit().
+         *
+         * With CONFIG_DRD_HISTORY_LENGTH above 0 this also writes the
+         * reset history to NVS if it gained entries since the last write.
+         * Backends without NVS keep the history in RTC memory only.
+         *
+         * @return ESP_OK on success or when nothing is staged.
+         * @return An ESP-IDF error code if the write failed.
+         */
+        esp_err_t flush();
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        /**
+         * @brief Configure an extra detector channel.
+         *
+         * Channels live in the primary detector's state record, so they
+         * share its storage handle, its RTC block and its boot write; a
+         * channel adds no NVS access at boot. The arm delay and the reset
+         * reason policy apply only to the primary channel, except that
+         * ignored resets are not evaluated on any channel. A firmware
+         * change restarts every channel. In timer mode one shared timer
+         * closes the channel windows. With CONFIG_DRD_UPTIME_DETECTION a
+         * channel cannot count power-on or brownout resets, which restart
+         * the RTC clock. Configure channels before the first evaluation.
+         *
+         * @param channel Channel number, from 1 to kExtraChannels.
+         * @param config  Window, counted reset reasons and sequence length.
+         *
+         * @return ESP_OK on success.
+         * @return ESP_ERR_INVALID_ARG if @p channel or @p config is out of
+         *         range.
+         * @return ESP_ERR_INVALID_STATE if this boot was already evaluated.
+         */
+        esp_err_t configure_channel(uint8_t channel,
+                                    const ChannelConfig &config);
+
+        /**
+         * @brief Tap count of an extra channel for this boot.
+         *
+         * Evaluates the boot with DrdConfig::window_ms if that has not
+         * happened yet. A sequence of max_taps ends immediately and the
+         * next counted reset starts again at 1.
+         *
+         * @param channel Channel number, from 1 to kExtraChannels.
+         *
+         * @return 0 if this reset does not count on the channel or the
+         *         channel is not configured, otherwise 1 to max_taps.
+         */
+        [[nodiscard]] uint8_t channel_taps(uint8_t channel);
+#endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        /**
+         * @brief Copy the reset history, newest boot first.
+         *
+         * The history survives every reset that keeps RTC memory. After
+         * power loss, NVS-backed builds restore it from the copy last
+         * written by flush() or by a detection.
+         *
+         * @param out Receives up to @p max entries.
+         * @param max Capacity of @p out.
+         *
+         * @return Number of entries written to @p out.
+         */
+        size_t history(HistoryEntry *out, size_t max) const;
+#endif
+
         /**
          * @brief Clear any stored double reset state.
          *
-         * For the RTC backend this clears the RTC markers. For the NVS
-         * backend this removes the stored keys from the namespace.
+         * For the RTC backend this clears the RTC record. For the NVS
+         * backend this removes the stored keys from the namespace. The
+         * Hybrid backend does both.
          */
         void clear_flag();
 
+        /**
+         * @brief Cumulative number of NVS state record writes.
+         *
+         * The counter is stored inside the record itself, so it covers the
+         * lifetime of the record rather than the current boot. Always zero
+         * for the RTC backend.
+         *
+         * @return Number of record writes issued so far.
+         */
+        [[nodiscard]] uint32_t write_count() const
+        {
+            return state_.write_count;
+        }
+
+        /**
+         * @brief Arm delay the current boot uses, in milliseconds.
+         *
+         * DrdConfig::arm_delay_ms unless CONFIG_DRD_ADAPTIVE_ARM_DELAY
+         * has tuned it from recent tooling reset bursts. Valid after
+         * check_taps().
+         *
+         * @return Delay before the window arms after a tooling reset or a
+         *         firmware update.
+         */
+        [[nodiscard]] uint32_t arm_delay_ms() const
+        {
+            return arm_delay_ms_;
+        }
+
+#if defined(CONFIG_DRD_ENABLE_STATS)
+        /**
+         * @brief Timing and operation counters for this boot.
+         *
+         * check_us includes configure() when check_and_clear() had to
+         * configure the detector itself. Timer callbacks keep adding to
+         * the NVS counters after check_and_clear() returns.
+         *
+         * @return Reference to the live counters.
+         */
+        [[nodiscard]] const Stats &stats() const;
+#endif
+
     private:
-        Backend backend_;
-        /// Borrowed pointer, usually a static string literal.
-        const char *nvs_namespace_ = "drd";
+        Storage storage_;
+        /// Used instead of storage_ when NVS could not be configured.
+        RtcStorage fallback_;
+        bool use_fallback_ = false;
         bool configured_ = false;
 
-        bool nvs_ready_ = false;
-        /// NVS handle stored as an integer; valid only when nvs_ready_ is true.
-        uint32_t nvs_handle_ = 0;
+        /// In-memory copy of the state record for this boot.
+        StateRecord state_{};
+
+        /// Serializes evaluation, configuration, the timer callback and
+        /// clear_flag(). Recursive, so an immediate arm from check_taps()
+        /// can reuse the timer path.
+        StaticSemaphore_t lock_buffer_{};
+        SemaphoreHandle_t lock_ = nullptr;
+
+        /// Evaluation state and tap count for this boot, see kResult* in
+        /// drd_handler.cpp. Written under lock_, read without it.
+        std::atomic<uint32_t> result_{0};
+        /// Sequence waiting for its window to close before dispatch.
+        uint8_t pending_taps_ = 0;
+
+        /// Tap handler registration, indexed by tap count.
+        struct TapSlot
+        {
+            TapHandler handler = nullptr;
+            void *arg = nullptr;
+        };
+        TapSlot tap_handlers_[kMaxTaps + 1] = {};
+
+        /// Observer registration, see set_event_callback().
+        EventCallback event_callback_ = nullptr;
+        void *event_arg_ = nullptr;
+
+        /// Events raised under lock_, delivered after it is released.
+        /// One evaluation or timer expiry raises at most three.
+        struct EventBatch
+        {
+            struct Entry
+            {
+                Event event;
+                uint8_t taps;
+            };
+            Entry entries[3] = {};
+            uint8_t count = 0;
+        };
+        EventBatch events_{};
 
-        /// Indicates whether this boot has already been evaluated.
-        bool evaluated_ = false;
-        /// Cached result for the current boot.
-        bool cached_result_ = false;
+        /// Background evaluation task; non-null while it is running.
+        TaskHandle_t async_task_ = nullptr;
+        /// Pending asynchronous request, consumed by async_task().
+        uint32_t async_window_ms_ = 0;
+        ResultCallback async_callback_ = nullptr;
+        void *async_arg_ = nullptr;
+        EventGroupHandle_t async_group_ = nullptr;
+        EventBits_t async_done_bits_ = 0;
+        EventBits_t async_detected_bits_ = 0;
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+        /// Control block and stack of the evaluation task.
+        StaticTask_t async_task_buffer_{};
+        StackType_t async_stack_[CONFIG_DRD_ASYNC_TASK_STACK_SIZE] = {};
+#endif
 
-        /// Timer that disarms the active double reset window.
-        esp_timer_handle_t disarm_timer_ = nullptr;
-        /// Timer that delays arming after a firmware update.
-        esp_timer_handle_t arm_timer_ = nullptr;
+        /// Stage the shared timer is currently counting down.
+        enum class TimerPhase : uint8_t
+        {
+            Idle,        ///< Not running.
+            ArmDelay,    ///< Delay before arming after a firmware update.
+            DisarmWindow ///< Active double reset window.
+        };
+
+        /// One-shot timer shared by both phases. Created once and
+        /// restarted, never recreated, for each phase.
+        esp_timer_handle_t timer_ = nullptr;
+        TimerPhase timer_phase_ = TimerPhase::Idle;
         /// Window length to use when arming after the delay.
-        uint32_t arm_window_s_ = 0;
+        uint32_t arm_window_ms_ = 0;
+        /// Delay before arming this boot, tuned by evaluate_tracked().
+        uint32_t arm_delay_ms_ = Config.arm_delay_ms;
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        ChannelConfig channel_config_[kExtraChannels] = {};
+        /// Result of each channel for this boot, published with result_.
+        uint8_t channel_taps_[kExtraChannels] = {};
+        /// Boot clock at which each open channel window closes, 0 if none.
+        int64_t channel_deadline_us_[kExtraChannels] = {};
+        /// Closes channel windows in timer mode. Shared by all channels.
+        esp_timer_handle_t channel_timer_ = nullptr;
+#endif
         /// Tracks whether the firmware identity is still considered dirty.
         bool firmware_id_dirty_ = false;
 
-        void schedule_disarm(uint32_t window_s);
-        void cancel_disarm();
-        static void disarm_timer_cb(void *arg);
+        uint8_t evaluate(uint32_t window_ms);
+        uint8_t evaluate_untracked(ResetAction action, uint32_t window_ms);
+        uint8_t evaluate_tracked(ResetAction action, uint32_t window_ms);
+        uint8_t count_tap();
+        void dispatch_taps(uint8_t taps);
+        [[nodiscard]] bool published(uint8_t &taps) const;
+
+        [[nodiscard]] bool observed() const;
+        void raise(Event event, uint8_t taps);
+        [[nodiscard]] EventBatch take_events();
+        void deliver(const EventBatch &batch);
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        [[nodiscard]] bool step_channels();
+        void schedule_channels();
+        static void channel_timer_cb(void *arg);
+#endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+        void record_history(uint8_t reason, ResetAction action, uint8_t taps);
+        esp_err_t persist_history();
+#endif
+
+        esp_err_t load_state();
+        esp_err_t store_state(const char *context);
+
+        esp_err_t start_async(uint32_t window_ms);
+        void finish_async(bool double_reset);
+        static void async_task(void *arg);
 
-        void cancel_arm();
-        void schedule_arm(uint32_t window_s);
-        static void arm_timer_cb(void *arg);
+        esp_err_t create_timer();
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        esp_err_t create_channel_timer();
+#endif
+        void start_timer(TimerPhase phase, uint64_t timeout_us);
+        void stop_timer();
+        static void timer_cb(void *arg);
+
+        void schedule_arm(uint32_t window_ms);
+        void schedule_disarm(uint32_t window_ms);
+        void on_arm_delay();
+        [[nodiscard]] uint8_t on_disarm_window();
     };
 
+#if defined(CONFIG_DRD_BACKEND_NVS)
+    /// Storage policy selected in Kconfig.
+    using DefaultStorage = NvsStorage;
+#elif defined(CONFIG_DRD_BACKEND_HYBRID)
+    using DefaultStorage = HybridStorage;
+#elif defined(CONFIG_DRD_BACKEND_FLASH)
+    using DefaultStorage = FlashRingStorage;
+#else
+    using DefaultStorage = RtcStorage;
+#endif
+
+    /// Detector type used by the global instance.
+    using DoubleResetDetector = BasicDetector<DefaultStorage>;
+
     /**
      * @brief Get the global DoubleResetDetector instance.
      *
      * The instance is configured at link time based on Kconfig options.
+     * The parameter only ties the caller to the component's
+     * kDefaultConfig, see ConfigTag; never pass it.
      *
      * @return Reference to the global detector.
      */
-    DoubleResetDetector &get();
+    DoubleResetDetector &get(DefaultConfigTag = {});
+
+#if defined(CONFIG_DRD_EARLY_EVALUATION)
+    /**
+     * @brief Tap count published by the early evaluation hook.
+     *
+     * The hook runs in the secondary init stage, before app_main, and
+     * does not touch the detector, so this can be called from any later
+     * init function or from the start of app_main without taking the
+     * detector lock. check_taps() returns the same count.
+     *
+     * @return Tap count, or 0 if the hook has not run.
+     */
+    [[nodiscard]] uint8_t early_taps();
+#endif
 
     /**
      * @brief Convenience wrapper around the global detector.
@@ -171,6 +1320,172 @@ namespace drd_handler
         return get().check_and_clear(window_s);
     }
 
+    /**
+     * @brief Convenience wrapper with a window in milliseconds.
+     *
+     * @param window_ms Detection window in milliseconds.
+     *
+     * @return true if a double reset was detected.
+     * @return false otherwise.
+     */
+    [[nodiscard]] inline bool check_and_clear_ms(uint32_t window_ms)
+    {
+        return get().check_and_clear_ms(window_ms);
+    }
+
+    /**
+     * @brief Convenience wrapper that counts consecutive resets.
+     *
+     * @param window_s Detection window in seconds.
+     *
+     * @return Number of consecutive resets, see BasicDetector::check_taps().
+     */
+    [[nodiscard]] inline uint8_t check_taps(uint32_t window_s)
+    {
+        return get().check_taps(window_s);
+    }
+
+    /**
+     * @brief Convenience wrapper that counts with a window in milliseconds.
+     *
+     * @param window_ms Detection window in milliseconds.
+     *
+     * @return Number of consecutive resets, see BasicDetector::check_taps().
+     */
+    [[nodiscard]] inline uint8_t check_taps_ms(uint32_t window_ms)
+    {
+        return get().check_taps_ms(window_ms);
+    }
+
+    /**
+     * @brief Convenience wrapper that registers a tap handler.
+     *
+     * @param taps    Tap count, from 2 to kMaxTaps.
+     * @param handler Handler to run, or nullptr to remove it.
+     * @param arg     User argument passed to @p handler.
+     *
+     * @return ESP_OK on success or an ESP-IDF error code.
+     */
+    inline esp_err_t register_tap_handler(uint8_t taps,
+                                          TapHandler handler,
+                                          void *arg = nullptr)
+    {
+        return get().register_tap_handler(taps, handler, arg);
+    }
+
+    /**
+     * @brief Convenience wrapper that registers the event observer.
+     *
+     * @param callback Observer to run, or nullptr to remove it.
+     * @param arg      User argument passed to @p callback.
+     *
+     * @return ESP_OK on success or an ESP-IDF error code.
+     */
+    inline esp_err_t set_event_callback(EventCallback callback,
+                                        void *arg = nullptr)
+    {
+        return get().set_event_callback(callback, arg);
+    }
+
+    /**
+     * @brief Convenience wrapper for asynchronous evaluation.
+     *
+     * @param window_s Detection window in seconds.
+     * @param callback Completion callback, may be nullptr.
+     * @param arg      User argument passed to @p callback.
+     *
+     * @return ESP_OK if evaluation was started or already complete.
+     */
+    inline esp_err_t check_and_clear_async(uint32_t window_s,
+                                           ResultCallback callback,
+                                           void *arg = nullptr)
+    {
+        return get().check_and_clear_async(window_s, callback, arg);
+    }
+
+    /**
+     * @brief Convenience wrapper for asynchronous evaluation with a window
+     * in milliseconds.
+     *
+     * @param window_ms Detection window in milliseconds.
+     * @param callback  Completion callback, may be nullptr.
+     * @param arg       User argument passed to @p callback.
+     *
+     * @return ESP_OK if evaluation was started or already complete.
+     */
+    inline esp_err_t check_and_clear_async_ms(uint32_t window_ms,
+                                              ResultCallback callback,
+                                              void *arg = nullptr)
+    {
+        return get().check_and_clear_async_ms(window_ms, callback, arg);
+    }
+
+    /**
+     * @brief Convenience wrapper that hands an NVS handle to the global
+     * detector.
+     *
+     * @param handle nvs_handle_t opened with NVS_READWRITE.
+     *
+     * @return ESP_OK on success or an ESP-IDF error code.
+     */
+    inline esp_err_t use_nvs_handle(uint32_t handle)
+    {
+        return get().use_nvs_handle(handle);
+    }
+
+    /**
+     * @brief Convenience wrapper that writes staged DRD state.
+     *
+     * @return ESP_OK on success or an ESP-IDF error code.
+     */
+    inline esp_err_t flush()
+    {
+        return get().flush();
+    }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+    /**
+     * @brief Convenience wrapper that configures an extra channel.
+     *
+     * @param channel Channel number, from 1 to kExtraChannels.
+     * @param config  Window, counted reset reasons and sequence length.
+     *
+     * @return ESP_OK on success or an ESP-IDF error code.
+     */
+    inline esp_err_t configure_channel(uint8_t channel,
+                                       const ChannelConfig &config)
+    {
+        return get().configure_channel(channel, config);
+    }
+
+    /**
+     * @brief Convenience wrapper that reads an extra channel's count.
+     *
+     * @param channel Channel number, from 1 to kExtraChannels.
+     *
+     * @return Tap count, see BasicDetector::channel_taps().
+     */
+    [[nodiscard]] inline uint8_t channel_taps(uint8_t channel)
+    {
+        return get().channel_taps(channel);
+    }
+#endif
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+    /**
+     * @brief Convenience wrapper that copies the reset history.
+     *
+     * @param out Receives up to @p max entries, newest first.
+     * @param max Capacity of @p out.
+     *
+     * @return Number of entries written to @p out.
+     */
+    inline size_t history(HistoryEntry *out, size_t max)
+    {
+        return get().history(out, max);
+    }
+#endif
+
     /**
      * @brief Convenience wrapper that clears the global DRD state.
      */
@@ -0,0 +1,1104 @@
+/**
+ * @file drd_sim.cpp
+ * @brief Randomized reset-sequence simulator for the DRD state machine.
+ *
+ * Each iteration boots a fresh detector on the simulated platform, runs it
+ * for a random uptime and resets it with a random reason. The resets
+ * follow a mix of user taps, long runs, flashing, tooling resets, power
+ * cycles, crash loops, brownouts and deep-sleep wakeups, optionally with
+ * power cuts during flash writes.
+ *
+ * Every boot is compared against the user's intent: a tap sequence is
+ * intended when a button reset arrives inside the window that the
+ * previous boot was expected to open. Reported results are per-boot
+ * flash traffic, simulated boot latency, false triggers and misses.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "drd_handler.hpp"
+#include "sim_platform.hpp"
+
+extern "C"
+{
+#include <nvs_flash.h>
+}
+
+namespace
+{
+    constexpr int64_t kUsPerSec = 1000000;
+    /// Settings of the detector under test, Kconfig or DRD_HANDLER_CONFIG.
+    constexpr const drd_handler::DrdConfig &kConfig =
+        drd_handler::kDefaultConfig;
+    constexpr int64_t kWindowUs =
+        static_cast<int64_t>(kConfig.window_ms) * 1000;
+    constexpr int64_t kArmDelayUs =
+        static_cast<int64_t>(kConfig.arm_delay_ms) * 1000;
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+    constexpr int64_t kArmDelayMinUs =
+        static_cast<int64_t>(CONFIG_DRD_ARM_DELAY_MIN_MS) * 1000;
+    constexpr int64_t kArmDelayMaxUs =
+        static_cast<int64_t>(CONFIG_DRD_ARM_DELAY_MAX_SECONDS) * kUsPerSec;
+#else
+    constexpr int64_t kArmDelayMaxUs = kArmDelayUs;
+#endif
+
+    constexpr bool kTracked = drd_handler::DefaultStorage::kTracksFirmware;
+
+    struct Options
+    {
+        uint64_t boots = 1000000;
+        uint64_t seed = 1;
+        bool button_power_on = false;
+        double tap_rate = 0.25;
+        double flash_rate = 0.03;
+        double tooling_rate = 0.05;
+        double power_cycle_rate = 0.03;
+        double panic_rate = 0.0;
+        double brownout_rate = 0.0;
+        double deep_sleep_rate = 0.0;
+        double power_cut_rate = 0.0;
+        double max_false_rate = -1.0;
+        double max_miss_rate = -1.0;
+        uint64_t app_entries = 0;
+        bool app_handle = false;
+        int64_t flush_after_ms = -1; ///< Call flush() this long after check.
+        bool observe = false;        ///< Register an event callback.
+        uint32_t channel_window_s = 15; ///< Window of extra channel 1.
+        uint32_t channel_window_ms = 0; ///< Overrides channel_window_s.
+        uint32_t channel_taps = 3;      ///< Sequence length of channel 1.
+        uint32_t channel_mask = 0;      ///< Reasons of channel 1, 0: button.
+        bool verbose = false;
+    };
+
+    enum class Event
+    {
+        LongRun,
+        Tap,
+        Flash,
+        Tooling,
+        PowerCycle,
+        Panic,
+        Brownout,
+        DeepSleep
+    };
+
+    /// What happens at the end of the current boot.
+    struct Plan
+    {
+        Event event = Event::LongRun;
+        int64_t uptime_us = 0;
+        esp_reset_reason_t next_reason = ESP_RST_EXT;
+        bool power_lost = false;
+        bool new_firmware = false;
+        int64_t sleep_us = 0; ///< Time in deep sleep before the next boot.
+    };
+
+    /// Firmware cleanliness as the intent model sees it.
+    enum class FirmwareState
+    {
+        Dirty,
+        Clean,
+        Unknown ///< A power cut may or may not have landed the arm write.
+    };
+
+    struct Results
+    {
+        uint64_t boots = 0;
+        uint64_t scored = 0;
+        uint64_t intended = 0;
+        uint64_t detected = 0;
+        uint64_t false_triggers = 0;
+        uint64_t misses = 0;
+        uint64_t count_mismatches = 0;
+        uint64_t power_cuts = 0;
+        uint64_t invariant_failures = 0;
+        uint64_t channel_scored = 0;
+        uint64_t channel_detected = 0;
+        uint64_t channel_mismatches = 0; ///< Channel 1 count off intent.
+        uint64_t arm_delay_ms_sum = 0;   ///< Arm delay of every boot.
+        std::vector<uint32_t> latency_us;
+    };
+
+    /// Detector events seen by the --observe callback.
+    struct Observed
+    {
+        uint32_t detected = 0;     ///< Detected events this boot.
+        uint8_t detected_taps = 0; ///< Count of the last Detected event.
+        bool window_open = false;  ///< Armed seen without a later Disarmed.
+        bool bad = false;          ///< Delivered under the lock or malformed.
+    };
+
+    void on_event(drd_handler::Event event, uint8_t taps, void *arg)
+    {
+        auto *seen = static_cast<Observed *>(arg);
+        if (sim::held_locks() != 0 || taps > drd_handler::kMaxTaps)
+        {
+            seen->bad = true;
+        }
+
+        switch (event)
+        {
+        case drd_handler::Event::Armed:
+            seen->window_open = true;
+            seen->bad = seen->bad || (taps == 0);
+            break;
+        case drd_handler::Event::Disarmed:
+            seen->window_open = false;
+            seen->bad = seen->bad || (taps == 0);
+            break;
+        case drd_handler::Event::Detected:
+            ++seen->detected;
+            seen->detected_taps = taps;
+            break;
+        case drd_handler::Event::FirmwareDirty:
+        case drd_handler::Event::FirmwareClean:
+            seen->bad = seen->bad || (taps != 0);
+            break;
+        }
+    }
+
+    int64_t uniform_us(std::mt19937_64 &rng, double min_s, double max_s)
+    {
+        std::uniform_real_distribution<double> dist(min_s, max_s);
+        return static_cast<int64_t>(dist(rng) * static_cast<double>(kUsPerSec));
+    }
+
+    esp_reset_reason_t button_reason(const Options &opt)
+    {
+        return opt.button_power_on ? ESP_RST_POWERON : ESP_RST_EXT;
+    }
+
+    bool is_button(const Options &opt, esp_reset_reason_t reason)
+    {
+        return reason == button_reason(opt);
+    }
+
+    /// Configured action for @p reason, with the documented precedence.
+    drd_handler::ResetAction policy(esp_reset_reason_t reason)
+    {
+        using drd_handler::ResetAction;
+
+        const uint32_t bit = 1u << static_cast<uint32_t>(reason);
+        if ((kConfig.ignore_mask & bit) != 0)
+        {
+            return ResetAction::Ignore;
+        }
+        if ((kConfig.delay_arm_mask & bit) != 0)
+        {
+            return ResetAction::DelayArm;
+        }
+        if ((kConfig.clear_mask & bit) != 0)
+        {
+            return ResetAction::Clear;
+        }
+        return ResetAction::Count;
+    }
+
+    Plan make_plan(const Options &opt, std::mt19937_64 &rng)
+    {
+        // Long runs always outlast the arm delay plus the window, and taps
+        // always land well inside the window, so intent is unambiguous.
+        const double long_min_s =
+            static_cast<double>(kArmDelayMaxUs + kWindowUs) / kUsPerSec + 5.0;
+        const double tap_max_s =
+            0.8 * static_cast<double>(kWindowUs) / kUsPerSec;
+        const double tap_min_s = std::min(0.3, 0.25 * tap_max_s);
+
+        std::uniform_real_distribution<double> pick(0.0, 1.0);
+        double p = pick(rng);
+
+        Plan plan;
+
+        auto take = [&p](double rate)
+        {
+            if (p < rate)
+            {
+                return true;
+            }
+            p -= rate;
+            return false;
+        };
+
+        if (take(opt.tap_rate))
+        {
+            plan.event = Event::Tap;
+            plan.uptime_us = uniform_us(rng, tap_min_s, tap_max_s);
+            plan.next_reason = button_reason(opt);
+        }
+        else if (take(opt.flash_rate))
+        {
+            plan.event = Event::Flash;
+            plan.uptime_us = uniform_us(rng, 0.3, 120.0);
+            plan.next_reason = ESP_RST_SW;
+            plan.new_firmware = true;
+        }
+        else if (take(opt.tooling_rate))
+        {
+            static constexpr esp_reset_reason_t kTooling[] = {
+                ESP_RST_SW,
+                ESP_RST_USB,
+                ESP_RST_JTAG,
+            };
+            std::uniform_int_distribution<int> which(0, 2);
+            plan.event = Event::Tooling;
+            plan.uptime_us = uniform_us(rng, 0.3, 120.0);
+            plan.next_reason = kTooling[which(rng)];
+        }
+        else if (take(opt.power_cycle_rate))
+        {
+            plan.event = Event::PowerCycle;
+            plan.uptime_us = uniform_us(rng, long_min_s, 3600.0);
+            plan.next_reason = ESP_RST_POWERON;
+            plan.power_lost = true;
+        }
+        else if (take(opt.panic_rate))
+        {
+            static constexpr esp_reset_reason_t kCrash[] = {
+                ESP_RST_PANIC,
+                ESP_RST_TASK_WDT,
+                ESP_RST_INT_WDT,
+            };
+            std::uniform_int_distribution<int> which(0, 2);
+            plan.event = Event::Panic;
+            plan.uptime_us = uniform_us(rng, 0.2, 5.0);
+            plan.next_reason = kCrash[which(rng)];
+        }
+        else if (take(opt.brownout_rate))
+        {
+            plan.event = Event::Brownout;
+            plan.uptime_us = uniform_us(rng, 0.2, 3.0);
+            plan.next_reason = ESP_RST_BROWNOUT;
+            plan.power_lost = true;
+        }
+        else if (take(opt.deep_sleep_rate))
+        {
+            // Wake, sample and go back to sleep; the sleep always outlasts
+            // the window.
+            plan.event = Event::DeepSleep;
+            plan.uptime_us = uniform_us(rng, 0.2, 5.0);
+            plan.next_reason = ESP_RST_DEEPSLEEP;
+            plan.sleep_us = uniform_us(rng, 30.0, 600.0);
+        }
+        else
+        {
+            plan.event = Event::LongRun;
+            plan.uptime_us = uniform_us(rng, long_min_s, 3600.0);
+            plan.next_reason = button_reason(opt);
+        }
+
+        // A power-on button also wipes RTC memory.
+        if (plan.next_reason == ESP_RST_POWERON)
+        {
+            plan.power_lost = true;
+        }
+
+        return plan;
+    }
+
+    const char *backend_name()
+    {
+        switch (drd_handler::DoubleResetDetector::kBackend)
+        {
+        case drd_handler::Backend::RTC:
+            return "rtc";
+        case drd_handler::Backend::NVS:
+            return "nvs";
+        case drd_handler::Backend::Hybrid:
+            return "hybrid";
+        case drd_handler::Backend::Flash:
+            return "flash";
+        }
+        return "?";
+    }
+
+    const char *mode_name()
+    {
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+        return "uptime";
+#else
+        return "timer";
+#endif
+    }
+
+    const char *partition_name()
+    {
+        return (kConfig.nvs_partition != nullptr) ? kConfig.nvs_partition
+                                                  : "-";
+    }
+
+    uint64_t platform_calls(const sim::Counters &c)
+    {
+        return c.nvs_inits + c.nvs_opens + c.nvs_reads + c.nvs_writes +
+               c.nvs_erases + c.nvs_commits + c.part_reads + c.part_writes +
+               c.part_erases + c.timer_creates;
+    }
+
+    double rate(uint64_t num, uint64_t den)
+    {
+        return (den == 0) ? 0.0
+                          : static_cast<double>(num) / static_cast<double>(den);
+    }
+
+    Results run(const Options &opt)
+    {
+        std::mt19937_64 rng(opt.seed);
+        sim::seed(opt.seed ^ 0x9E3779B97F4A7C15ull);
+        sim::set_power_cut_rate(opt.power_cut_rate);
+        sim::set_log_level(opt.verbose ? ESP_LOG_INFO : ESP_LOG_NONE);
+        sim::erase_flash();
+        sim::fill_partition(NVS_DEFAULT_PART_NAME,
+                            static_cast<uint32_t>(opt.app_entries));
+        sim::reset_counters();
+
+        Results res;
+        res.latency_us.reserve(static_cast<size_t>(opt.boots));
+
+        uint32_t image = 1;
+        sim::set_firmware(image);
+
+        // Reset that starts the next boot.
+        esp_reset_reason_t reason = ESP_RST_POWERON;
+        bool power_lost = true;
+
+        // Intent model.
+        FirmwareState firmware = FirmwareState::Dirty;
+        bool window_open = false;   // Previous boot left a window open.
+        uint8_t intended_taps = 0;  // Expected count of the previous boot.
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        // Channel 1 intent. An uncertain state is resynchronized from the
+        // detector's own count once the next boot has been evaluated.
+        drd_handler::ChannelConfig channel;
+        channel.window_s = opt.channel_window_s;
+        channel.window_ms = opt.channel_window_ms;
+        channel.reset_mask = (opt.channel_mask != 0)
+                                 ? opt.channel_mask
+                                 : (1u << static_cast<uint32_t>(
+                                        button_reason(opt)));
+        channel.max_taps = static_cast<uint8_t>(opt.channel_taps);
+        const int64_t channel_window_us =
+            (opt.channel_window_ms != 0)
+                ? static_cast<int64_t>(opt.channel_window_ms) * 1000
+                : static_cast<int64_t>(opt.channel_window_s) * kUsPerSec;
+        // Resets near the deadline may land on either side of the timer.
+        constexpr int64_t kChannelMarginUs = kUsPerSec / 10;
+        bool channel_known = true;
+        bool channel_open = false;
+        uint8_t channel_prev = 0;
+        bool channel_opens = false;
+        uint32_t evaluated_image = 0;
+#endif
+
+        uint32_t trace_mismatches = 0;
+
+        // RTC history holds an entry with a known evaluation time.
+        [[maybe_unused]] bool history_timed = false;
+
+        // The previous boot reset while its arm delay was ending, so its
+        // window may or may not have opened.
+        bool window_uncertain = false;
+
+        for (uint64_t i = 0; i < opt.boots; ++i)
+        {
+            const uint64_t calls_before = platform_calls(sim::counters());
+            sim::boot(reason, power_lost);
+            ++res.boots;
+
+            // Intent for this boot, decided by how the previous one ended.
+            const bool scored = (firmware != FirmwareState::Unknown) &&
+                                !window_uncertain;
+            const bool intended = window_open && is_button(opt, reason);
+            const uint8_t expected =
+                intended ? static_cast<uint8_t>(
+                               std::min<int>(intended_taps + 1,
+                                             drd_handler::kMaxTaps))
+                         : 1;
+
+            const bool dirty_at_boot = kTracked &&
+                                       (firmware != FirmwareState::Clean);
+            const drd_handler::ResetAction action = policy(reason);
+            const bool tooling_boot =
+                (action == drd_handler::ResetAction::DelayArm);
+            const bool clear_boot = (action == drd_handler::ResetAction::Clear);
+            // Ignored reasons other than deep sleep would leave the previous
+            // window running, which this model does not track.
+            const bool ignored_boot =
+                (action == drd_handler::ResetAction::Ignore);
+
+            // The application's own NVS setup is not part of DRD latency.
+            std::optional<drd_handler::DoubleResetDetector> detector;
+            detector.emplace();
+
+            if (opt.app_handle &&
+                (drd_handler::DoubleResetDetector::kBackend ==
+                     drd_handler::Backend::NVS ||
+                 drd_handler::DoubleResetDetector::kBackend ==
+                     drd_handler::Backend::Hybrid))
+            {
+                nvs_handle_t h = 0;
+                if (nvs_flash_init() != ESP_OK ||
+                    nvs_open("drd", NVS_READWRITE, &h) != ESP_OK ||
+                    detector->use_nvs_handle(h) != ESP_OK)
+                {
+                    ++res.invariant_failures;
+                }
+            }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+            if (detector->configure_channel(1, channel) != ESP_OK)
+            {
+                ++res.invariant_failures;
+            }
+#endif
+
+            Observed seen;
+            if (opt.observe &&
+                detector->set_event_callback(&on_event, &seen) != ESP_OK)
+            {
+                ++res.invariant_failures;
+            }
+
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+            // Everything that allocates happens here, during init.
+            (void)detector->configure();
+            const sim::Counters configured = sim::counters();
+#endif
+
+            // Evaluate.
+            const int64_t t0 = sim::now_us();
+            uint8_t taps = 0;
+            bool cut = false;
+
+            try
+            {
+                taps = detector->check_taps();
+            }
+            catch (const sim::PowerCut &)
+            {
+                cut = true;
+            }
+
+            const int64_t t1 = sim::now_us();
+            res.latency_us.push_back(static_cast<uint32_t>(t1 - t0));
+
+            if (taps > drd_handler::kMaxTaps)
+            {
+                ++res.invariant_failures;
+            }
+
+            const bool detected = (taps >= 2);
+            res.detected += detected ? 1 : 0;
+
+#if defined(DRD_HANDLER_HAS_HISTORY)
+            // The newest entry describes this boot, and its gap is known
+            // unless the RTC clock restarted since the previous entry.
+            if (!cut && !ignored_boot)
+            {
+                drd_handler::HistoryEntry newest{};
+                if (detector->history(&newest, 1) != 1 ||
+                    newest.reset_reason != static_cast<uint8_t>(reason) ||
+                    newest.action != action || newest.taps != taps ||
+                    (newest.gap_s != drd_handler::kHistoryGapUnknown) !=
+                        (history_timed && !power_lost))
+                {
+                    ++res.invariant_failures;
+                }
+                history_timed = true;
+            }
+#endif
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+            if (!cut && !ignored_boot)
+            {
+                using drd_handler::Backend;
+                constexpr Backend kBackend =
+                    drd_handler::DoubleResetDetector::kBackend;
+
+                const bool identity_changed =
+                    kTracked && image != evaluated_image;
+                bool open = channel_open && !identity_changed &&
+                            !(power_lost && kBackend == Backend::RTC);
+#if defined(CONFIG_DRD_UPTIME_DETECTION)
+                // A restarted RTC clock leaves the gap unknown.
+                open = open && reason != ESP_RST_POWERON &&
+                       reason != ESP_RST_BROWNOUT;
+#endif
+                const bool counts =
+                    (channel.reset_mask &
+                     (1u << static_cast<uint32_t>(reason))) != 0;
+                const uint8_t expected_channel =
+                    !counts ? 0
+                    : open  ? static_cast<uint8_t>(std::min<int>(
+                                 channel_prev + 1, channel.max_taps))
+                            : 1;
+
+                // Hybrid keeps channel arms in RTC memory only.
+                const bool channel_scored =
+                    channel_known &&
+                    !(power_lost && kBackend == Backend::Hybrid);
+
+                const uint8_t got = detector->channel_taps(1);
+                res.channel_detected += (got >= 2) ? 1 : 0;
+                if (channel_scored)
+                {
+                    ++res.channel_scored;
+                    res.channel_mismatches += (got != expected_channel) ? 1 : 0;
+                }
+
+                channel_prev = channel_scored ? expected_channel : got;
+                channel_opens = counts && channel_prev < channel.max_taps;
+                channel_known = true;
+                evaluated_image = image;
+            }
+#endif
+
+            // Exactly one Detected event for a detection, with its count.
+            if (opt.observe && !cut &&
+                (seen.detected != (detected ? 1u : 0u) ||
+                 (detected && seen.detected_taps != taps)))
+            {
+                ++res.invariant_failures;
+            }
+
+            if (scored && !cut)
+            {
+                ++res.scored;
+                res.intended += intended ? 1 : 0;
+                if (detected && !intended)
+                {
+                    ++res.false_triggers;
+                }
+                else if (!detected && intended)
+                {
+                    ++res.misses;
+                }
+                else if (detected && taps != expected)
+                {
+                    ++res.count_mismatches;
+                }
+            }
+
+            // Run until the next reset.
+            const Plan plan = make_plan(opt, rng);
+
+            [[maybe_unused]] bool flushed = false;
+            if (!cut)
+            {
+                try
+                {
+                    // A reset before the flush point loses staged writes.
+                    const int64_t flush_at_us = t1 + opt.flush_after_ms * 1000;
+                    if (opt.flush_after_ms >= 0 && plan.uptime_us >= flush_at_us)
+                    {
+                        sim::run_until(flush_at_us);
+                        (void)detector->flush();
+                        flushed = true;
+                    }
+                    sim::run_until(plan.uptime_us);
+                }
+                catch (const sim::PowerCut &)
+                {
+                    cut = true;
+                }
+            }
+
+#if defined(CONFIG_DRD_STATIC_ALLOCATION)
+            // Evaluation and the timer callbacks never allocate.
+            const sim::Counters &now = sim::counters();
+            if (!cut && (now.timer_creates != configured.timer_creates ||
+                         now.nvs_inits != configured.nvs_inits ||
+                         now.nvs_opens != configured.nvs_opens))
+            {
+                ++res.invariant_failures;
+            }
+#endif
+
+            const int64_t uptime_us = sim::now_us();
+            const int64_t arm_delay_us =
+                static_cast<int64_t>(detector->arm_delay_ms()) * 1000;
+            detector.reset();
+            res.arm_delay_ms_sum += static_cast<uint64_t>(arm_delay_us / 1000);
+
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+            // A tuned delay stays within its bounds.
+            if (arm_delay_us != kArmDelayUs &&
+                (arm_delay_us < kArmDelayMinUs ||
+                 arm_delay_us > kArmDelayMaxUs))
+            {
+                ++res.invariant_failures;
+            }
+#endif
+
+            // A long run outlasts every window, so its Disarmed arrived.
+            if (opt.observe &&
+                (seen.bad ||
+                 (!cut && plan.event == Event::LongRun && seen.window_open)))
+            {
+                ++res.invariant_failures;
+            }
+
+            if (sim::live_timers() != 0 || sim::held_locks() != 0)
+            {
+                ++res.invariant_failures;
+            }
+
+            // Every traced phase ends, even when a power cut unwinds it.
+            if (sim::open_trace_events() != 0 ||
+                sim::trace_mismatches() != trace_mismatches)
+            {
+                ++res.invariant_failures;
+                trace_mismatches = sim::trace_mismatches();
+            }
+
+            // An ignored reset must not touch storage or create a timer.
+            if (ignored_boot &&
+                (taps != 0 ||
+                 platform_calls(sim::counters()) != calls_before))
+            {
+                ++res.invariant_failures;
+            }
+
+            // Window the intent model expects this boot to have opened.
+            int64_t window_start_us = 0;
+            bool opens_window = true;
+            bool delayed_edge = false;
+
+            if (intended && expected >= drd_handler::kMaxTaps)
+            {
+                opens_window = false; // Sequence complete.
+            }
+            else if (kTracked && (dirty_at_boot || tooling_boot) &&
+                     !(intended && expected >= 2))
+            {
+                // The delay starts during the check, so a reset within the
+                // check's span after it may land on either side.
+                window_start_us = t1 + arm_delay_us;
+                delayed_edge = uptime_us >= t0 + arm_delay_us &&
+                               uptime_us < window_start_us;
+            }
+            else if (!kTracked && tooling_boot)
+            {
+                opens_window = false;
+            }
+            else if (clear_boot)
+            {
+                opens_window = false;
+            }
+
+#if defined(CONFIG_DRD_DEFERRED_COMMIT)
+            // A fresh arm made during the check is staged until flush(), so
+            // a reset before it loses the window. Advancing taps and delayed
+            // arms are written at once.
+            if (opens_window && window_start_us == 0 && !flushed &&
+                !(intended && expected >= 2))
+            {
+                opens_window = false;
+            }
+#endif
+
+            if (ignored_boot || plan.event == Event::DeepSleep)
+            {
+                // An ignored boot opens no window, and a sleep closes any
+                // window that was open.
+                opens_window = false;
+            }
+
+            // The arm delay starts during the check, so a reset that lands
+            // inside the check's span after the delay may go either way. A
+            // skipped boot never starts it.
+            if (dirty_at_boot && !ignored_boot &&
+                uptime_us >= t0 + arm_delay_us)
+            {
+                firmware = (uptime_us >= t1 + arm_delay_us)
+                               ? FirmwareState::Clean
+                               : FirmwareState::Unknown;
+            }
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+            if (!cut && !ignored_boot)
+            {
+                // The channel deadline is set during the check.
+                channel_open = false;
+                if (channel_opens &&
+                    uptime_us < t0 + channel_window_us - kChannelMarginUs)
+                {
+                    channel_open = true;
+                }
+                else if (channel_opens &&
+                         uptime_us < t1 + channel_window_us + kChannelMarginUs)
+                {
+                    channel_known = false;
+                }
+            }
+            channel_known = channel_known && !cut;
+#endif
+
+            if (cut)
+            {
+                ++res.power_cuts;
+                if (firmware != FirmwareState::Clean)
+                {
+                    firmware = FirmwareState::Unknown;
+                }
+                opens_window = false;
+                reason = ESP_RST_POWERON;
+                power_lost = true;
+                history_timed = false;
+            }
+            else
+            {
+                reason = plan.next_reason;
+                power_lost = plan.power_lost;
+                sim::advance_rtc(plan.sleep_us);
+            }
+
+            window_open = opens_window &&
+                          uptime_us >= window_start_us &&
+                          (uptime_us - window_start_us) < kWindowUs;
+            intended_taps = opens_window ? expected : 0;
+            window_uncertain = opens_window && delayed_edge;
+
+            if (!cut && plan.new_firmware)
+            {
+                sim::set_firmware(++image);
+                firmware = FirmwareState::Dirty;
+            }
+        }
+
+        return res;
+    }
+
+    void report(const Options &opt, Results &res)
+    {
+        const sim::Counters &c = sim::counters();
+        const double n = static_cast<double>(res.boots);
+
+        std::sort(res.latency_us.begin(), res.latency_us.end());
+        auto pct = [&res](double q)
+        {
+            if (res.latency_us.empty())
+            {
+                return 0u;
+            }
+            const size_t idx = static_cast<size_t>(
+                q * static_cast<double>(res.latency_us.size() - 1));
+            return res.latency_us[idx];
+        };
+
+        uint64_t latency_sum = 0;
+        for (const uint32_t v : res.latency_us)
+        {
+            latency_sum += v;
+        }
+
+        std::printf("backend=%s mode=%s max_taps=%u partition=%s%s "
+                    "button=%s boots=%" PRIu64 " seed=%" PRIu64 "\n",
+                    backend_name(),
+                    mode_name(),
+                    static_cast<unsigned>(drd_handler::kMaxTaps),
+                    partition_name(),
+                    opt.app_handle ? " app_handle" : "",
+                    opt.button_power_on ? "poweron" : "ext",
+                    res.boots,
+                    opt.seed);
+        std::printf("  nvs per boot: init=%.3f open=%.3f read=%.3f write=%.3f "
+                    "erase=%.3f commit=%.3f timer_create=%.3f\n",
+                    static_cast<double>(c.nvs_inits) / n,
+                    static_cast<double>(c.nvs_opens) / n,
+                    static_cast<double>(c.nvs_reads) / n,
+                    static_cast<double>(c.nvs_writes) / n,
+                    static_cast<double>(c.nvs_erases) / n,
+                    static_cast<double>(c.nvs_commits) / n,
+                    static_cast<double>(c.timer_creates) / n);
+        std::printf("  partition per boot: read=%.3f write=%.3f "
+                    "sector_erase=%.4f\n",
+                    static_cast<double>(c.part_reads) / n,
+                    static_cast<double>(c.part_writes) / n,
+                    static_cast<double>(c.part_erases) / n);
+        std::printf("  check latency us: mean=%.0f p50=%u p99=%u max=%u\n",
+                    static_cast<double>(latency_sum) / n,
+                    pct(0.50),
+                    pct(0.99),
+                    pct(1.0));
+        std::printf("  scored=%" PRIu64 " intended=%" PRIu64
+                    " detected=%" PRIu64 " power_cuts=%" PRIu64 "\n",
+                    res.scored,
+                    res.intended,
+                    res.detected,
+                    res.power_cuts);
+        std::printf("  false_triggers=%" PRIu64 " (%.6f of unintended)"
+                    " misses=%" PRIu64 " (%.6f of intended)"
+                    " count_mismatches=%" PRIu64 "\n",
+                    res.false_triggers,
+                    rate(res.false_triggers, res.scored - res.intended),
+                    res.misses,
+                    rate(res.misses, res.intended),
+                    res.count_mismatches);
+
+#if defined(CONFIG_DRD_ADAPTIVE_ARM_DELAY)
+        std::printf("  mean arm delay ms: %.0f\n",
+                    static_cast<double>(res.arm_delay_ms_sum) / n);
+#endif
+
+#if defined(CONFIG_DRD_TRACE)
+        std::printf("  trace events per boot: %.3f\n",
+                    static_cast<double>(c.trace_events) / n);
+#endif
+
+#if defined(DRD_HANDLER_HAS_CHANNELS)
+        std::printf("  channel 1: scored=%" PRIu64 " detected=%" PRIu64
+                    " mismatches=%" PRIu64 "\n",
+                    res.channel_scored,
+                    res.channel_detected,
+                    res.channel_mismatches);
+#endif
+
+        if (res.invariant_failures != 0)
+        {
+            std::printf("  invariant_failures=%" PRIu64 "\n",
+                        res.invariant_failures);
+        }
+    }
+
+    bool parse_double(const char *s, double &out)
+    {
+        char *end = nullptr;
+        out = std::strtod(s, &end);
+        return end != s && *end == '\0';
+    }
+
+    bool parse_u64(const char *s, uint64_t &out)
+    {
+        char *end = nullptr;
+        out = std::strtoull(s, &end, 10);
+        return end != s && *end == '\0';
+    }
+
+    void usage(const char *argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--boots N] [--seed N] [--button ext|poweron]\n"
+                     "          [--tap-rate P] [--flash-rate P] "
+                     "[--tooling-rate P]\n"
+                     "          [--power-cycle-rate P] [--panic-rate P] "
+                     "[--brownout-rate P]\n"
+                     "          [--deep-sleep-rate P] [--power-cut-rate P]\n"
+                     "          [--max-false-rate R] [--max-miss-rate R]\n"
+                     "          [--app-entries N] [--app-handle] "
+                     "[--flush-after-ms N]\n"
+                     "          [--observe] [--channel-window S] "
+                     "[--channel-taps N]\n"
+                     "          [--channel-window-ms N] [--channel-mask HEX] "
+                     "[--verbose]\n",
+                     argv0);
+    }
+
+    bool parse(int argc, char **argv, Options &opt)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const char *arg = argv[i];
+            const char *val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+            struct RateFlag
+            {
+                const char *name;
+                double *target;
+            };
+            const RateFlag rates[] = {
+                {"--tap-rate", &opt.tap_rate},
+                {"--flash-rate", &opt.flash_rate},
+                {"--tooling-rate", &opt.tooling_rate},
+                {"--power-cycle-rate", &opt.power_cycle_rate},
+                {"--panic-rate", &opt.panic_rate},
+                {"--brownout-rate", &opt.brownout_rate},
+                {"--deep-sleep-rate", &opt.deep_sleep_rate},
+                {"--power-cut-rate", &opt.power_cut_rate},
+                {"--max-false-rate", &opt.max_false_rate},
+                {"--max-miss-rate", &opt.max_miss_rate},
+            };
+
+            bool handled = false;
+            for (const RateFlag &flag : rates)
+            {
+                if (std::strcmp(arg, flag.name) == 0)
+                {
+                    if (val == nullptr || !parse_double(val, *flag.target))
+                    {
+                        return false;
+                    }
+                    ++i;
+                    handled = true;
+                    break;
+                }
+            }
+
+            if (handled)
+            {
+                continue;
+            }
+
+            if (std::strcmp(arg, "--boots") == 0 && val != nullptr)
+            {
+                if (!parse_u64(val, opt.boots))
+                {
+                    return false;
+                }
+                ++i;
+            }
+            else if (std::strcmp(arg, "--seed") == 0 && val != nullptr)
+            {
+                if (!parse_u64(val, opt.seed))
+                {
+                    return false;
+                }
+                ++i;
+            }
+            else if (std::strcmp(arg, "--button") == 0 && val != nullptr)
+            {
+                if (std::strcmp(val, "ext") == 0)
+                {
+                    opt.button_power_on = false;
+                }
+                else if (std::strcmp(val, "poweron") == 0)
+                {
+                    opt.button_power_on = true;
+                }
+                else
+                {
+                    return false;
+                }
+                ++i;
+            }
+            else if (std::strcmp(arg, "--app-entries") == 0 && val != nullptr)
+            {
+                if (!parse_u64(val, opt.app_entries))
+                {
+                    return false;
+                }
+                ++i;
+            }
+            else if (std::strcmp(arg, "--flush-after-ms") == 0 &&
+                     val != nullptr)
+            {
+                uint64_t ms = 0;
+                if (!parse_u64(val, ms))
+                {
+                    return false;
+                }
+                opt.flush_after_ms = static_cast<int64_t>(ms);
+                ++i;
+            }
+            else if (std::strcmp(arg, "--app-handle") == 0)
+            {
+                opt.app_handle = true;
+            }
+            else if (std::strcmp(arg, "--observe") == 0)
+            {
+                opt.observe = true;
+            }
+            else if ((std::strcmp(arg, "--channel-window") == 0 ||
+                      std::strcmp(arg, "--channel-window-ms") == 0 ||
+                      std::strcmp(arg, "--channel-taps") == 0 ||
+                      std::strcmp(arg, "--channel-mask") == 0) &&
+                     val != nullptr)
+            {
+                const bool mask = std::strcmp(arg, "--channel-mask") == 0;
+                char *end = nullptr;
+                const unsigned long v = std::strtoul(val, &end, mask ? 16 : 10);
+                if (end == val || *end != '\0')
+                {
+                    return false;
+                }
+                if (mask)
+                {
+                    opt.channel_mask = static_cast<uint32_t>(v);
+                }
+                else if (std::strcmp(arg, "--channel-window") == 0)
+                {
+                    opt.channel_window_s = static_cast<uint32_t>(v);
+                }
+                else if (std::strcmp(arg, "--channel-window-ms") == 0)
+                {
+                    opt.channel_window_ms = static_cast<uint32_t>(v);
+                }
+                else
+                {
+                    opt.channel_taps = static_cast<uint32_t>(v);
+                }
+                ++i;
+            }
+            else if (std::strcmp(arg, "--verbose") == 0)
+            {
+                opt.verbose = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse(argc, argv, opt))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Results res = run(opt);
+    report(opt, res);
+
+    int status = 0;
+
+    if (res.invariant_failures != 0)
+    {
+        std::printf("FAIL: invariant failures\n");
+        status = 1;
+    }
+
+    const double false_rate =
+        rate(res.false_triggers, res.scored - res.intended);
+    if (opt.max_false_rate >= 0.0 && false_rate > opt.max_false_rate)
+    {
+        std::printf("FAIL: false trigger rate %.6f above %.6f\n",
+                    false_rate,
+                    opt.max_false_rate);
+        status = 1;
+    }
+
+    // Strict runs also hold the extra channel to its intent.
+    if ((opt.max_false_rate >= 0.0 || opt.max_miss_rate >= 0.0) &&
+        res.channel_mismatches != 0)
+    {
+        std::printf("FAIL: channel count mismatches\n");
+        status = 1;
+    }
+
+    // A wrong count dispatches the wrong handler, so it misses the
+    // intended one.
+    const double miss_rate =
+        rate(res.misses + res.count_mismatches, res.intended);
+    if (opt.max_miss_rate >= 0.0 && miss_rate > opt.max_miss_rate)
+    {
+        std::printf("FAIL: miss rate %.6f above %.6f\n",
+                    miss_rate,
+                    opt.max_miss_rate);
+        status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file SEGGER_SYSVIEW.h
+ * @brief Host mock of the SystemView user event calls. Starts and stops
+ * are checked for nesting by the simulator.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    void SEGGER_SYSVIEW_OnUserStart(unsigned user_id);
+    void SEGGER_SYSVIEW_OnUserStop(unsigned user_id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file esp_app_desc.h
+ * @brief Host mock of the application descriptor.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t magic_word;
+    uint32_t secure_version;
+    char version[32];
+    char project_name[32];
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// Descriptor of the simulated firmware image.
+    const esp_app_desc_t *esp_app_get_description(void);
+
+#ifdef __cplusplus
+}
+#endif
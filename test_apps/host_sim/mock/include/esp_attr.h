@@ -0,0 +1,12 @@
+/**
+ * @file esp_attr.h
+ * @brief Host mock of the RTC memory attributes.
+ *
+ * RTC variables are collected in one section so the simulator can fill it
+ * with noise to model power loss.
+ */
+
+#pragma once
+
+#define RTC_DATA_ATTR __attribute__((section("rtc_sim")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_sim")))
@@ -0,0 +1,33 @@
+/**
+ * @file startup_internal.h
+ * @brief Host mock of ESP_SYSTEM_INIT_FN. Registered functions run from
+ * sim::boot(), after the reset state is set up and before the simulator
+ * constructs the detector.
+ */
+
+#pragma once
+
+#include <esp_err.h>
+
+#ifndef BIT
+#define BIT(nr) (1UL << (nr))
+#endif
+
+typedef esp_err_t (*sim_init_fn_t)(void);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    int sim_register_init_fn(sim_init_fn_t fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define ESP_SYSTEM_INIT_FN(f, stage, core, priority)                 \
+    static esp_err_t f(void);                                        \
+    [[maybe_unused]] static const int f##_registration =             \
+        sim_register_init_fn(&f);                                    \
+    static esp_err_t f(void)
@@ -0,0 +1,19 @@
+/**
+ * @file esp_rtc_time.h
+ * @brief Host mock of the RTC clock, which survives resets but not power loss.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    uint64_t esp_rtc_get_time_us(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+/**
+ * @file esp_timer.h
+ * @brief Host mock of esp_timer driven by the simulated clock.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum
+{
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR
+} esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                               esp_timer_handle_t *out_handle);
+    esp_err_t esp_timer_start_once(esp_timer_handle_t timer,
+                                   uint64_t timeout_us);
+    esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+    esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+    bool esp_timer_is_active(esp_timer_handle_t timer);
+
+    /// Simulated time since the current boot, in microseconds.
+    int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
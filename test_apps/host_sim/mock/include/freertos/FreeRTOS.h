@@ -0,0 +1,20 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host mock of the FreeRTOS base types.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffu
+#define BIT0 0x1
+#define BIT1 0x2
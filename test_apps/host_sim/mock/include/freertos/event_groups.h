@@ -0,0 +1,22 @@
+/**
+ * @file event_groups.h
+ * @brief Host mock of FreeRTOS event groups.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+
+#ifdef __cplusplus
+}
+#endif
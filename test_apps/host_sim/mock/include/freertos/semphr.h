@@ -0,0 +1,31 @@
+/**
+ * @file semphr.h
+ * @brief Host mock of FreeRTOS recursive mutexes. The simulator is single
+ * threaded, so a mutex only tracks its hold depth.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct StaticSemaphore
+{
+    uint32_t depth;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(
+        StaticSemaphore_t *buffer);
+    BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex,
+                                       TickType_t ticks);
+    BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex);
+    void vSemaphoreDelete(SemaphoreHandle_t mutex);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+/**
+ * @file task.h
+ * @brief Host mock of FreeRTOS tasks. Tasks run to completion on creation.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint8_t StackType_t;
+
+typedef struct StaticTask
+{
+    uint32_t unused;
+} StaticTask_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    BaseType_t xTaskCreate(TaskFunction_t task,
+                           const char *name,
+                           uint32_t stack_depth,
+                           void *arg,
+                           UBaseType_t priority,
+                           TaskHandle_t *out_handle);
+    TaskHandle_t xTaskCreateStatic(TaskFunction_t task,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *arg,
+                                   UBaseType_t priority,
+                                   StackType_t *stack,
+                                   StaticTask_t *buffer);
+    void vTaskDelete(TaskHandle_t task);
+
+#ifdef __cplusplus
+}
+#endif
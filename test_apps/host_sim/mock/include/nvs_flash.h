@@ -0,0 +1,20 @@
+/**
+ * @file nvs_flash.h
+ * @brief Host mock of NVS initialization.
+ */
+
+#pragma once
+
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    esp_err_t nvs_flash_init(void);
+    esp_err_t nvs_flash_init_partition(const char *partition_label);
+
+#ifdef __cplusplus
+}
+#endif
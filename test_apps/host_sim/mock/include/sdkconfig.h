@@ -0,0 +1,85 @@
+/**
+ * @file sdkconfig.h
+ * @brief Kconfig defaults for host simulation builds.
+ *
+ * The backend and any non-default option are passed as compile
+ * definitions by CMakeLists.txt; everything else matches Kconfig.
+ */
+
+#pragma once
+
+#if !defined(CONFIG_DRD_BACKEND_RTC) && \
+    !defined(CONFIG_DRD_BACKEND_NVS) && \
+    !defined(CONFIG_DRD_BACKEND_HYBRID) && \
+    !defined(CONFIG_DRD_BACKEND_FLASH)
+#define CONFIG_DRD_BACKEND_NVS 1
+#endif
+
+#define CONFIG_DRD_SUPPRESS_TOOLING_RESETS 1
+#define CONFIG_DRD_WINDOW_SECONDS 8
+#define CONFIG_DRD_ARM_DELAY_SECONDS 10
+#if !defined(CONFIG_DRD_WINDOW_MS)
+#define CONFIG_DRD_WINDOW_MS 0
+#endif
+#if !defined(CONFIG_DRD_ARM_DELAY_MS)
+#define CONFIG_DRD_ARM_DELAY_MS 0
+#endif
+#define CONFIG_DRD_ARM_DELAY_MIN_MS 1000
+#define CONFIG_DRD_ARM_DELAY_MAX_SECONDS 60
+#define CONFIG_DRD_ASYNC_TASK_STACK_SIZE 3072
+#define CONFIG_DRD_ASYNC_TASK_PRIORITY 1
+
+#if !defined(CONFIG_DRD_RESET_IGNORE_MASK)
+#if defined(CONFIG_DRD_EVALUATE_DEEP_SLEEP_WAKEUPS)
+#define CONFIG_DRD_RESET_IGNORE_MASK 0x0
+#else
+#define CONFIG_DRD_RESET_IGNORE_MASK 0x100
+#endif
+#endif
+#if !defined(CONFIG_DRD_RESET_DELAY_ARM_MASK)
+#define CONFIG_DRD_RESET_DELAY_ARM_MASK 0x1808
+#endif
+#if !defined(CONFIG_DRD_RESET_CLEAR_MASK)
+#define CONFIG_DRD_RESET_CLEAR_MASK 0x0
+#endif
+
+#if !defined(CONFIG_DRD_EXTRA_CHANNELS)
+#define CONFIG_DRD_EXTRA_CHANNELS 0
+#endif
+
+#if !defined(CONFIG_DRD_HISTORY_LENGTH)
+#define CONFIG_DRD_HISTORY_LENGTH 0
+#endif
+
+#if defined(CONFIG_DRD_TRACE) && !defined(CONFIG_DRD_TRACE_ID_BASE)
+#define CONFIG_DRD_TRACE_ID_BASE 64
+#endif
+
+#if !defined(CONFIG_DRD_MAX_TAPS)
+#define CONFIG_DRD_MAX_TAPS 2
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_NVS) || defined(CONFIG_DRD_BACKEND_HYBRID)
+#define CONFIG_DRD_NVS_NAMESPACE "drd"
+#if !defined(CONFIG_DRD_NVS_PARTITION)
+#define CONFIG_DRD_NVS_PARTITION "nvs"
+#endif
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_NVS) && !defined(SIM_NO_NVS_RTC_CACHE)
+#define CONFIG_DRD_NVS_RTC_CACHE 1
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_FLASH)
+#define CONFIG_DRD_FLASH_PARTITION "drd"
+#endif
+
+#if defined(CONFIG_DRD_BACKEND_NVS) || defined(CONFIG_DRD_BACKEND_HYBRID) || \
+    defined(CONFIG_DRD_BACKEND_FLASH)
+#if !defined(SIM_NO_WRITE_COALESCING)
+#define CONFIG_DRD_WRITE_COALESCING 1
+#endif
+#if !defined(CONFIG_DRD_MAX_WRITES_PER_BOOT)
+#define CONFIG_DRD_MAX_WRITES_PER_BOOT 4
+#endif
+#endif
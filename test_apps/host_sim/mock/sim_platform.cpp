@@ -0,0 +1,900 @@
+/**
+ * @file sim_platform.cpp
+ * @brief Implementation of the simulated ESP-IDF platform.
+ *
+ * Flash operations advance the boot clock by a fixed cost so the
+ * simulator can report boot latency. The costs are rough figures for NVS
+ * on a 2 MB/s SPI flash and are only meant for comparing configurations.
+ */
+
+#include "sim_platform.hpp"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <SEGGER_SYSVIEW.h>
+#include <esp_app_desc.h>
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <esp_private/startup_internal.h>
+#include <esp_rom_crc.h>
+#include <esp_rtc_time.h>
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+    // Generated by the linker for the section used by RTC_NOINIT_ATTR.
+    extern char __start_rtc_sim[];
+    extern char __stop_rtc_sim[];
+}
+
+struct esp_timer
+{
+    esp_timer_cb_t callback = nullptr;
+    void *arg = nullptr;
+    int64_t deadline_us = 0;
+    bool active = false;
+};
+
+namespace
+{
+    // Simulated cost of each platform call, in microseconds.
+    constexpr int64_t kBootloaderUs = 250000;
+    constexpr int64_t kNvsInitUs = 2000;
+    constexpr int64_t kNvsInitPerPageUs = 1500;
+    constexpr int64_t kNvsOpenUs = 150;
+    constexpr int64_t kNvsReadUs = 80;
+    constexpr int64_t kNvsWriteUs = 600;
+    constexpr int64_t kNvsEraseUs = 350;
+    constexpr int64_t kNvsCommitUs = 30;
+    constexpr int64_t kTimerCreateUs = 15;
+    constexpr int64_t kPartReadUs = 25;
+    constexpr int64_t kPartWriteUs = 60;
+    constexpr int64_t kSectorEraseUs = 45000;
+
+    constexpr uint32_t kSectorSize = 4096;
+    // Raw partition for the flash ring backend, two sectors.
+    constexpr uint32_t kRingPartitionSize = 2 * kSectorSize;
+
+    // Entries per 4 kB NVS page, and pages every partition starts with.
+    constexpr uint32_t kNvsEntriesPerPage = 126;
+    constexpr uint32_t kNvsMinPages = 3;
+
+    enum class EntryType : uint8_t
+    {
+        U8,
+        U32,
+        Blob
+    };
+
+    struct Entry
+    {
+        EntryType type = EntryType::Blob;
+        std::vector<uint8_t> data;
+    };
+
+    std::map<std::string, Entry> s_flash;
+    // Handle to "partition\0namespace", the key prefix of its entries.
+    std::map<nvs_handle_t, std::string> s_handles;
+    nvs_handle_t s_next_handle = 1;
+    std::set<std::string> s_initialized;
+    // Application entries that share a partition with DRD.
+    std::map<std::string, uint32_t> s_fill;
+
+    esp_partition_t s_ring_partition = {
+        ESP_PARTITION_TYPE_DATA,
+        static_cast<esp_partition_subtype_t>(0x40),
+        0x3F0000,
+        kRingPartitionSize,
+        kSectorSize,
+        "drd",
+        false,
+    };
+    std::vector<uint8_t> s_ring_flash(kRingPartitionSize, 0xFF);
+
+    std::vector<std::unique_ptr<esp_timer>> s_timers;
+
+    // Mutex holds not yet released, summed over all mutexes.
+    uint32_t s_locks_held = 0;
+
+    // Open SystemView user events, innermost last.
+    std::vector<unsigned> s_trace_stack;
+    uint32_t s_trace_mismatches = 0;
+
+    // ESP_SYSTEM_INIT_FN registrations. Function-local so registration
+    // from another translation unit's static init is safe.
+    std::vector<sim_init_fn_t> &init_fns()
+    {
+        static std::vector<sim_init_fn_t> fns;
+        return fns;
+    }
+
+    int64_t s_now_us = 0;
+    uint64_t s_rtc_base_us = 0;
+    esp_reset_reason_t s_reason = ESP_RST_POWERON;
+    esp_log_level_t s_log_level = ESP_LOG_NONE;
+
+    esp_app_desc_t s_app = {};
+
+    std::mt19937_64 s_rng(1);
+    double s_power_cut_rate = 0.0;
+
+    sim::Counters s_counters;
+
+    void charge(int64_t cost_us)
+    {
+        s_now_us += cost_us;
+    }
+
+    bool power_fails()
+    {
+        if (s_power_cut_rate <= 0.0)
+        {
+            return false;
+        }
+
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        return dist(s_rng) < s_power_cut_rate;
+    }
+
+    // Called before every flash mutation.
+    void maybe_cut_power()
+    {
+        if (power_fails())
+        {
+            throw sim::PowerCut{};
+        }
+    }
+
+    bool valid_range(const esp_partition_t *partition,
+                     size_t offset,
+                     size_t size)
+    {
+        return partition == &s_ring_partition &&
+               offset <= partition->size &&
+               size <= partition->size - offset;
+    }
+
+    std::string make_key(nvs_handle_t handle, const char *key)
+    {
+        return s_handles.at(handle) + '\0' + key;
+    }
+
+    bool valid_handle(nvs_handle_t handle)
+    {
+        return s_handles.count(handle) != 0;
+    }
+
+    esp_err_t get_scalar(nvs_handle_t handle,
+                         const char *key,
+                         EntryType type,
+                         void *out,
+                         size_t len)
+    {
+        if (!valid_handle(handle))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kNvsReadUs);
+        ++s_counters.nvs_reads;
+
+        const auto it = s_flash.find(make_key(handle, key));
+        if (it == s_flash.end())
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        if (it->second.type != type)
+        {
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+        }
+
+        std::memcpy(out, it->second.data.data(), len);
+        return ESP_OK;
+    }
+
+    esp_err_t set_entry(nvs_handle_t handle,
+                        const char *key,
+                        EntryType type,
+                        const void *value,
+                        size_t len)
+    {
+        if (!valid_handle(handle))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kNvsWriteUs);
+        maybe_cut_power();
+        ++s_counters.nvs_writes;
+
+        Entry entry;
+        entry.type = type;
+        entry.data.assign(static_cast<const uint8_t *>(value),
+                          static_cast<const uint8_t *>(value) + len);
+        s_flash[make_key(handle, key)] = std::move(entry);
+        return ESP_OK;
+    }
+
+} // namespace
+
+namespace sim
+{
+    void boot(esp_reset_reason_t reason, bool power_lost)
+    {
+        if (power_lost)
+        {
+            s_rtc_base_us = 0;
+
+            std::uniform_int_distribution<int> noise(0, 255);
+            for (char *p = __start_rtc_sim; p != __stop_rtc_sim; ++p)
+            {
+                *p = static_cast<char>(noise(s_rng));
+            }
+        }
+        else
+        {
+            s_rtc_base_us += static_cast<uint64_t>(s_now_us);
+        }
+
+        s_reason = reason;
+        s_now_us = kBootloaderUs;
+        s_initialized.clear();
+        s_handles.clear();
+
+        for (const sim_init_fn_t fn : init_fns())
+        {
+            (void)fn();
+        }
+    }
+
+    void advance_rtc(int64_t us)
+    {
+        s_rtc_base_us += static_cast<uint64_t>(us);
+    }
+
+    void run_until(int64_t uptime_us)
+    {
+        for (;;)
+        {
+            esp_timer *next = nullptr;
+            for (const auto &timer : s_timers)
+            {
+                if (timer->active &&
+                    timer->deadline_us <= uptime_us &&
+                    (next == nullptr || timer->deadline_us < next->deadline_us))
+                {
+                    next = timer.get();
+                }
+            }
+
+            if (next == nullptr)
+            {
+                break;
+            }
+
+            s_now_us = std::max(s_now_us, next->deadline_us);
+            next->active = false;
+            next->callback(next->arg);
+        }
+
+        s_now_us = std::max(s_now_us, uptime_us);
+    }
+
+    int64_t now_us()
+    {
+        return s_now_us;
+    }
+
+    uint32_t live_timers()
+    {
+        return static_cast<uint32_t>(s_timers.size());
+    }
+
+    uint32_t open_trace_events()
+    {
+        return static_cast<uint32_t>(s_trace_stack.size());
+    }
+
+    uint32_t trace_mismatches()
+    {
+        return s_trace_mismatches;
+    }
+
+    uint32_t held_locks()
+    {
+        return s_locks_held;
+    }
+
+    void set_firmware(uint32_t image_id)
+    {
+        std::memset(s_app.app_elf_sha256, 0, sizeof(s_app.app_elf_sha256));
+        std::memcpy(s_app.app_elf_sha256, &image_id, sizeof(image_id));
+        // Keep the tail non-zero so no image hashes to all zeros.
+        s_app.app_elf_sha256[31] = 0xA5;
+    }
+
+    void set_power_cut_rate(double probability)
+    {
+        s_power_cut_rate = probability;
+    }
+
+    void seed(uint64_t value)
+    {
+        s_rng.seed(value);
+    }
+
+    void set_log_level(esp_log_level_t level)
+    {
+        s_log_level = level;
+    }
+
+    Counters &counters()
+    {
+        return s_counters;
+    }
+
+    void reset_counters()
+    {
+        s_counters = Counters{};
+    }
+
+    void erase_flash()
+    {
+        s_flash.clear();
+        std::fill(s_ring_flash.begin(), s_ring_flash.end(), 0xFF);
+    }
+
+    void fill_partition(const char *partition, uint32_t entries)
+    {
+        s_fill[partition] = entries;
+    }
+
+} // namespace sim
+
+extern "C"
+{
+    const char *esp_err_to_name(esp_err_t code)
+    {
+        switch (code)
+        {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_INVALID_CRC:
+            return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_NVS_NOT_INITIALIZED:
+            return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH:
+            return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            return "ESP_ERR_NVS_INVALID_LENGTH";
+        default:
+            return "UNKNOWN_ERROR";
+        }
+    }
+
+    esp_log_level_t esp_log_level_get(const char *tag)
+    {
+        (void)tag;
+        return s_log_level;
+    }
+
+    void esp_log_level_set(const char *tag, esp_log_level_t level)
+    {
+        // Only the DRD tag logs, so one level covers every tag.
+        (void)tag;
+        s_log_level = level;
+    }
+
+    void esp_log_write(esp_log_level_t level,
+                       const char *tag,
+                       const char *format,
+                       ...)
+    {
+        if (level > s_log_level)
+        {
+            return;
+        }
+
+        std::printf("[%10lld] %s: ", static_cast<long long>(s_now_us), tag);
+
+        va_list args;
+        va_start(args, format);
+        std::vprintf(format, args);
+        va_end(args);
+
+        std::printf("\n");
+    }
+
+    uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+    {
+        crc = ~crc;
+        for (uint32_t i = 0; i < len; ++i)
+        {
+            crc ^= buf[i];
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+            }
+        }
+        return ~crc;
+    }
+
+    uint64_t esp_rtc_get_time_us(void)
+    {
+        return s_rtc_base_us + static_cast<uint64_t>(s_now_us);
+    }
+
+    esp_reset_reason_t esp_reset_reason(void)
+    {
+        return s_reason;
+    }
+
+    const esp_app_desc_t *esp_app_get_description(void)
+    {
+        return &s_app;
+    }
+
+    int64_t esp_timer_get_time(void)
+    {
+        return s_now_us;
+    }
+
+    void SEGGER_SYSVIEW_OnUserStart(unsigned user_id)
+    {
+        ++s_counters.trace_events;
+        s_trace_stack.push_back(user_id);
+    }
+
+    void SEGGER_SYSVIEW_OnUserStop(unsigned user_id)
+    {
+        if (s_trace_stack.empty() || s_trace_stack.back() != user_id)
+        {
+            ++s_trace_mismatches;
+            return;
+        }
+        s_trace_stack.pop_back();
+    }
+
+    esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                               esp_timer_handle_t *out_handle)
+    {
+        if (args == nullptr || args->callback == nullptr || out_handle == nullptr)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kTimerCreateUs);
+        ++s_counters.timer_creates;
+
+        auto timer = std::make_unique<esp_timer>();
+        timer->callback = args->callback;
+        timer->arg = args->arg;
+        *out_handle = timer.get();
+        s_timers.push_back(std::move(timer));
+        return ESP_OK;
+    }
+
+    esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+    {
+        if (timer == nullptr)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (timer->active)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        timer->active = true;
+        timer->deadline_us = s_now_us + static_cast<int64_t>(timeout_us);
+        return ESP_OK;
+    }
+
+    esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+    {
+        if (timer == nullptr)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (!timer->active)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        timer->active = false;
+        return ESP_OK;
+    }
+
+    esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+    {
+        if (timer == nullptr)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (timer->active)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        const auto it = std::find_if(s_timers.begin(),
+                                     s_timers.end(),
+                                     [timer](const auto &t)
+                                     { return t.get() == timer; });
+        if (it == s_timers.end())
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        s_timers.erase(it);
+        return ESP_OK;
+    }
+
+    bool esp_timer_is_active(esp_timer_handle_t timer)
+    {
+        return timer != nullptr && timer->active;
+    }
+
+    const esp_partition_t *esp_partition_find_first(
+        esp_partition_type_t type,
+        esp_partition_subtype_t subtype,
+        const char *label)
+    {
+        if (type != s_ring_partition.type ||
+            (subtype != ESP_PARTITION_SUBTYPE_ANY &&
+             subtype != s_ring_partition.subtype) ||
+            label == nullptr ||
+            std::strcmp(label, s_ring_partition.label) != 0)
+        {
+            return nullptr;
+        }
+
+        return &s_ring_partition;
+    }
+
+    esp_err_t esp_partition_read(const esp_partition_t *partition,
+                                 size_t src_offset,
+                                 void *dst,
+                                 size_t size)
+    {
+        if (!valid_range(partition, src_offset, size))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kPartReadUs);
+        ++s_counters.part_reads;
+        std::memcpy(dst, &s_ring_flash[src_offset], size);
+        return ESP_OK;
+    }
+
+    esp_err_t esp_partition_write(const esp_partition_t *partition,
+                                  size_t dst_offset,
+                                  const void *src,
+                                  size_t size)
+    {
+        if (!valid_range(partition, dst_offset, size))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kPartWriteUs);
+
+        // Programming only clears bits. A cut leaves the write torn.
+        const bool cut = power_fails();
+        const size_t len = cut ? size / 2 : size;
+        const auto *bytes = static_cast<const uint8_t *>(src);
+        for (size_t i = 0; i < len; ++i)
+        {
+            s_ring_flash[dst_offset + i] &= bytes[i];
+        }
+
+        if (cut)
+        {
+            throw sim::PowerCut{};
+        }
+
+        ++s_counters.part_writes;
+        return ESP_OK;
+    }
+
+    esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                        size_t offset,
+                                        size_t size)
+    {
+        if (!valid_range(partition, offset, size) ||
+            offset % kSectorSize != 0 ||
+            size % kSectorSize != 0)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kSectorEraseUs * static_cast<int64_t>(size / kSectorSize));
+        maybe_cut_power();
+        s_counters.part_erases += size / kSectorSize;
+
+        std::fill(s_ring_flash.begin() + static_cast<std::ptrdiff_t>(offset),
+                  s_ring_flash.begin() +
+                      static_cast<std::ptrdiff_t>(offset + size),
+                  0xFF);
+        return ESP_OK;
+    }
+
+    esp_err_t nvs_flash_init_partition(const char *partition_label)
+    {
+        // Initializing an already initialized partition is a lookup.
+        if (!s_initialized.insert(partition_label).second)
+        {
+            return ESP_OK;
+        }
+
+        // Mounting scans every page that holds entries.
+        const uint32_t pages =
+            kNvsMinPages + s_fill[partition_label] / kNvsEntriesPerPage;
+        charge(kNvsInitUs + kNvsInitPerPageUs * pages);
+        ++s_counters.nvs_inits;
+        return ESP_OK;
+    }
+
+    esp_err_t nvs_flash_init(void)
+    {
+        return nvs_flash_init_partition(NVS_DEFAULT_PART_NAME);
+    }
+
+    esp_err_t nvs_open_from_partition(const char *part_name,
+                                      const char *namespace_name,
+                                      nvs_open_mode_t open_mode,
+                                      nvs_handle_t *out_handle)
+    {
+        (void)open_mode;
+
+        if (s_initialized.count(part_name) == 0)
+        {
+            return ESP_ERR_NVS_NOT_INITIALIZED;
+        }
+
+        charge(kNvsOpenUs);
+        ++s_counters.nvs_opens;
+
+        const nvs_handle_t handle = s_next_handle++;
+        s_handles[handle] = std::string(part_name) + '\0' + namespace_name;
+        *out_handle = handle;
+        return ESP_OK;
+    }
+
+    esp_err_t nvs_open(const char *name,
+                       nvs_open_mode_t open_mode,
+                       nvs_handle_t *out_handle)
+    {
+        return nvs_open_from_partition(NVS_DEFAULT_PART_NAME,
+                                       name,
+                                       open_mode,
+                                       out_handle);
+    }
+
+    void nvs_close(nvs_handle_t handle)
+    {
+        s_handles.erase(handle);
+    }
+
+    esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+    {
+        return get_scalar(handle, key, EntryType::U8, out, sizeof(*out));
+    }
+
+    esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+    {
+        return get_scalar(handle, key, EntryType::U32, out, sizeof(*out));
+    }
+
+    esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+    {
+        return set_entry(handle, key, EntryType::U8, &value, sizeof(value));
+    }
+
+    esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+    {
+        return set_entry(handle, key, EntryType::U32, &value, sizeof(value));
+    }
+
+    esp_err_t nvs_get_blob(nvs_handle_t handle,
+                           const char *key,
+                           void *out,
+                           size_t *length)
+    {
+        if (!valid_handle(handle) || length == nullptr)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        charge(kNvsReadUs);
+        ++s_counters.nvs_reads;
+
+        const auto it = s_flash.find(make_key(handle, key));
+        if (it == s_flash.end())
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        if (it->second.type != EntryType::Blob)
+        {
+            return ESP_ERR_NVS_TYPE_MISMATCH;
+        }
+
+        const size_t size = it->second.data.size();
+        if (out == nullptr)
+        {
+            *length = size;
+            return ESP_OK;
+        }
+
+        if (*length < size)
+        {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+
+        std::memcpy(out, it->second.data.data(), size);
+        *length = size;
+        return ESP_OK;
+    }
+
+    esp_err_t nvs_set_blob(nvs_handle_t handle,
+                           const char *key,
+                           const void *value,
+                           size_t length)
+    {
+        return set_entry(handle, key, EntryType::Blob, value, length);
+    }
+
+    esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+    {
+        if (!valid_handle(handle))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        const auto it = s_flash.find(make_key(handle, key));
+        if (it == s_flash.end())
+        {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+
+        charge(kNvsEraseUs);
+        maybe_cut_power();
+        ++s_counters.nvs_erases;
+
+        s_flash.erase(it);
+        return ESP_OK;
+    }
+
+    esp_err_t nvs_commit(nvs_handle_t handle)
+    {
+        if (!valid_handle(handle))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        // Entries reach flash in nvs_set_*(), as in ESP-IDF, so a commit
+        // has nothing left to lose.
+        charge(kNvsCommitUs);
+        ++s_counters.nvs_commits;
+        return ESP_OK;
+    }
+
+    BaseType_t xTaskCreate(TaskFunction_t task,
+                           const char *name,
+                           uint32_t stack_depth,
+                           void *arg,
+                           UBaseType_t priority,
+                           TaskHandle_t *out_handle)
+    {
+        (void)name;
+        (void)stack_depth;
+        (void)priority;
+
+        static int s_task_token;
+        if (out_handle != nullptr)
+        {
+            *out_handle = reinterpret_cast<TaskHandle_t>(&s_task_token);
+        }
+
+        task(arg);
+        return pdPASS;
+    }
+
+    TaskHandle_t xTaskCreateStatic(TaskFunction_t task,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *arg,
+                                   UBaseType_t priority,
+                                   StackType_t *stack,
+                                   StaticTask_t *buffer)
+    {
+        (void)stack;
+
+        TaskHandle_t handle = nullptr;
+        (void)xTaskCreate(task, name, stack_depth, arg, priority, &handle);
+        return reinterpret_cast<TaskHandle_t>(buffer);
+    }
+
+    void vTaskDelete(TaskHandle_t task)
+    {
+        (void)task;
+    }
+
+    EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+    {
+        (void)group;
+        return bits;
+    }
+
+    int sim_register_init_fn(sim_init_fn_t fn)
+    {
+        init_fns().push_back(fn);
+        return 0;
+    }
+
+    SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(
+        StaticSemaphore_t *buffer)
+    {
+        buffer->depth = 0;
+        return buffer;
+    }
+
+    BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex,
+                                       TickType_t ticks)
+    {
+        (void)ticks;
+        ++mutex->depth;
+        ++s_locks_held;
+        return pdTRUE;
+    }
+
+    BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex)
+    {
+        if (mutex->depth == 0)
+        {
+            return pdFALSE;
+        }
+
+        --mutex->depth;
+        --s_locks_held;
+        return pdTRUE;
+    }
+
+    void vSemaphoreDelete(SemaphoreHandle_t mutex)
+    {
+        (void)mutex;
+    }
+}
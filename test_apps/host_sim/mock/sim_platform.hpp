@@ -0,0 +1,98 @@
+/**
+ * @file sim_platform.hpp
+ * @brief Control surface of the simulated ESP-IDF platform.
+ *
+ * The mocks in mock/include are backed by a virtual clock, an in-memory
+ * NVS store and an RTC memory section that can be wiped. The simulator
+ * drives them through the functions declared here.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+extern "C"
+{
+#include <esp_log.h>
+#include <esp_system.h>
+}
+
+namespace sim
+{
+    /// Thrown by a flash operation that was interrupted by power loss.
+    struct PowerCut
+    {
+    };
+
+    /// Platform operation counters, cumulative until reset_counters().
+    struct Counters
+    {
+        uint64_t nvs_inits = 0;
+        uint64_t nvs_opens = 0;
+        uint64_t nvs_reads = 0;
+        uint64_t nvs_writes = 0;  ///< nvs_set_*() calls that reached flash.
+        uint64_t nvs_erases = 0;  ///< nvs_erase_key() calls that reached flash.
+        uint64_t nvs_commits = 0;
+        uint64_t part_reads = 0;
+        uint64_t part_writes = 0;  ///< esp_partition_write() calls completed.
+        uint64_t part_erases = 0;  ///< Sectors erased.
+        uint64_t timer_creates = 0;
+        uint64_t trace_events = 0; ///< SystemView user events started.
+    };
+
+    /**
+     * @brief Start a new simulated boot.
+     *
+     * Resets the boot clock and NVS initialization state. When
+     * @p power_lost is set, the RTC clock restarts and RTC memory is
+     * filled with noise, as it would be after a power-on reset.
+     *
+     * @param reason     Reset reason reported by esp_reset_reason().
+     * @param power_lost Whether RTC memory and the RTC clock were lost.
+     */
+    void boot(esp_reset_reason_t reason, bool power_lost);
+
+    /// Advance the RTC clock by @p us without booting, as in deep sleep.
+    void advance_rtc(int64_t us);
+
+    /// Advance the boot clock to @p uptime_us, firing due timers in order.
+    void run_until(int64_t uptime_us);
+
+    /// Microseconds since the current boot.
+    int64_t now_us();
+
+    /// Number of timers that have been created and not deleted.
+    uint32_t live_timers();
+
+    /// Number of mutex takes not yet matched by a give.
+    uint32_t held_locks();
+
+    /// SystemView user events started and not yet stopped.
+    uint32_t open_trace_events();
+
+    /// Stops that did not match the innermost open user event.
+    uint32_t trace_mismatches();
+
+    /// Select the firmware image reported by esp_app_get_description().
+    void set_firmware(uint32_t image_id);
+
+    /// Probability that power fails during any single flash operation.
+    void set_power_cut_rate(double probability);
+
+    /// Seed the random source used for power cuts and RTC noise.
+    void seed(uint64_t value);
+
+    /// Log level reported by esp_log_level_get() and used for output.
+    void set_log_level(esp_log_level_t level);
+
+    Counters &counters();
+    void reset_counters();
+
+    /// Forget all NVS contents, as after erasing the partition.
+    void erase_flash();
+
+    /// Model @p entries application entries in @p partition; mounting
+    /// the partition then scans correspondingly more pages.
+    void fill_partition(const char *partition, uint32_t entries);
+
+} // namespace sim